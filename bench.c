@@ -0,0 +1,381 @@
+/* bench.c
+ *
+ * Desc:
+ * Micro benchmarks for the hot paths of todo: load, sort, filter, query, search,
+ * list, save and html render, over generated task files from 1k to 1M tasks,
+ * and date parsing.
+ * Sorts and date scans are also run over an array of Task structs, the
+ * layout the store used before, and every date kernel of range.h is timed
+ * against a difftime loop, to compare. localtime_r() and mktime() are
+ * timed against tz.h, that caches the zone. HTTP request heads are parsed
+ * whole and a byte at a time. Done tasks with long descriptions are
+ * archived and read back. Results are printed as CSV, one line per
+ * operation and size.
+ *
+ * Usage:
+ * make bench
+ * ./todo-bench [MAX_TASKS]
+ *
+ * Author: Hugo Coto Florez
+ * Repo: https://github.com/hugootoflorez/todo
+ * License: licenseless
+ * Standard: C11
+ * ------------------------------------------------------*/
+
+#define TODO_NO_MAIN
+#include "todo.c"
+
+#define BENCH_FILE TMP_PATH "todo-bench.out"
+
+static uint64_t bench_start_ns;
+static uint64_t bench_best_ns;
+
+/* Run the code after SETUP RUNS times and keep the fastest run in
+ * bench_best_ns. SETUP is run before each measurement and is not timed. */
+#define BENCH(runs, setup, ...)                                             \
+        do {                                                                \
+                bench_best_ns = UINT64_MAX;                                 \
+                for (int _r_ = 0; _r_ < (runs); _r_++) {                    \
+                        setup;                                              \
+                        bench_start_ns = metrics_now_ns();                  \
+                        __VA_ARGS__;                                        \
+                        bench_start_ns = metrics_now_ns() - bench_start_ns; \
+                        if (bench_start_ns < bench_best_ns)                 \
+                                bench_best_ns = bench_start_ns;             \
+                }                                                           \
+        } while (0)
+
+static void
+report(const char *op, int tasks)
+{
+        printf("%s,%d,%.9f,%.1f\n", op, tasks, bench_best_ns / 1e9,
+               (double) bench_best_ns / (tasks ? tasks : 1));
+        fflush(stdout);
+}
+
+/* Array of tasks, only used to compare with the store layout */
+typedef DA(Task) Task_da;
+
+static int
+compare_tasks_by_date(const void *a, const void *b)
+{
+        const Task *ea = a;
+        const Task *eb = b;
+        return (ea->due > eb->due) - (ea->due < eb->due);
+}
+
+/* Copy the columns of SRC into DST, that has to have room for them */
+static void
+store_copy(Store *dst, const Store *src)
+{
+#define X(col) memcpy(dst->col, src->col, sizeof *src->col * src->size);
+        STORE_COLUMNS(X)
+#undef X
+        dst->size = src->size;
+}
+
+static void
+bench_size(int size)
+{
+        int runs = size >= 1000000 ? 1 : 3;
+        Store shuffled = { 0 };
+        Task *aos;
+        Task *aos_shuffled;
+        Row_da filter;
+        uint64_t *mask;
+        uint64_t *expected;
+        const char *error;
+        time_t limit;
+        char *page;
+        size_t page_len;
+        FILE *stream;
+        int devnull;
+
+        /* Generate the file once. gen_tasks() is not measured */
+        destroy_all();
+        gen_tasks(&data, size, size);
+        load_to_file(&data, BENCH_FILE);
+
+        BENCH(runs, destroy_all(), load_from_file(&data, BENCH_FILE));
+        report("load_from_file", size);
+
+        /* Generated tasks are not sorted by date */
+#define X(col)                                               \
+        shuffled.col = malloc(sizeof *data.col * data.size); \
+        assert(shuffled.col);
+        STORE_COLUMNS(X)
+#undef X
+        store_copy(&shuffled, &data);
+        aos = malloc(sizeof *aos * data.size);
+        aos_shuffled = malloc(sizeof *aos * data.size);
+        assert(aos && aos_shuffled);
+        for (int row = 0; row < data.size; row++)
+                aos_shuffled[row] = store_get(&data, row);
+
+        BENCH(runs, memcpy(aos, aos_shuffled, sizeof *aos * size),
+              qsort(aos, size, sizeof *aos, compare_tasks_by_date));
+        report("aos_qsort", size);
+
+        BENCH(runs, store_copy(&data, &shuffled), store_sort(&data));
+        report("store_sort", size);
+
+        limit = days(30);
+        BENCH(runs, , {
+                Task_da aos_filter = { 0 };
+                for (int i = 0; i < size; i++)
+                        if (difftime(aos[i].due, limit) <= 0)
+                                da_append(&aos_filter, aos[i]);
+                da_destroy(&aos_filter);
+        });
+        report("aos_tasks_before", size);
+
+        BENCH(runs, , filter = tasks_before(&data, *tz_localtime(&limit, &(struct tm) { 0 })); da_destroy(&filter));
+        report("tasks_before", size);
+
+        /* Date kernels alone, over unsorted dates. The difftime loop is how
+         * tasks_before() compared dates before range.h */
+        mask = malloc(sizeof *mask * RANGE_WORDS(size));
+        expected = malloc(sizeof *expected * RANGE_WORDS(size));
+        assert(mask && expected);
+        BENCH(runs, , {
+                for (int w = 0, i = 0; i < size; w++) {
+                        uint64_t m = 0;
+                        for (int b = 0; b < 64 && i < size; b++, i++)
+                                if (difftime(shuffled.due[i], limit) <= 0)
+                                        m |= 1ull << b;
+                        expected[w] = m;
+                }
+        });
+        report("difftime_scan", size);
+
+        for (int impl = 0; impl <= (int) range_best_impl(); impl++) {
+                char op[64];
+                BENCH(runs, , range_select_impl(impl, shuffled.due, size, RANGE_TIME_MIN, limit, mask));
+                assert(memcmp(mask, expected, sizeof *mask * RANGE_WORDS(size)) == 0);
+                snprintf(op, sizeof op, "range_select_%s", range_impl_names[impl]);
+                report(op, size);
+        }
+        free(expected);
+        free(mask);
+
+        BENCH(runs, , filter = tasks_where(&data, "due<+30d and tag:ops and prio>=2", &error); da_destroy(&filter));
+        report("query", size);
+
+        BENCH(1, (index_destroy(&data.search.ix), data.search.built = false),
+              filter = tasks_matching(&data, "task"); da_destroy(&filter));
+        report("search_build", size);
+
+        BENCH(runs, , filter = tasks_matching(&data, "desc 99"); da_destroy(&filter));
+        report("search", size);
+
+        devnull = open("/dev/null", O_WRONLY);
+        assert(devnull >= 0);
+        filter = store_rows(&data);
+        BENCH(runs, , list_tasks(&data, devnull, filter, RANGE_TIME_MIN, "Tasks"));
+        report("list_tasks", size);
+        da_destroy(&filter);
+        close(devnull);
+
+        BENCH(runs, , load_to_file(&data, BENCH_FILE));
+        report("load_to_file", size);
+
+        BENCH(runs, (page = NULL, page_len = 0, stream = open_memstream(&page, &page_len)),
+              render_page(&data, stream, "/");
+              fclose(stream);
+              free(page));
+        report("render_page", size);
+
+#define X(col) free(shuffled.col);
+        STORE_COLUMNS(X)
+#undef X
+        free(aos_shuffled);
+        free(aos);
+}
+
+/* Date parsing does not depend on the number of tasks. parse_date() is
+ * how todo.out dates are read */
+static void
+bench_dates(void)
+{
+        static const char *exprs[] = {
+                "fri 17:00", "+3d", "2026-11-01 9am", "next mon",
+                "in 2 weeks", "tomorrow noon", "15/11/2026 08:30", "+2h",
+        };
+        const int n = 100000;
+        time_t now = time(NULL);
+        volatile time_t sink = 0;
+        char formatted[DATETIME_MAXLEN];
+        const char *error;
+
+        strcpy(formatted, overload_date(now));
+
+        BENCH(3, , for (int i = 0; i < n; i++) sink += date_parse(exprs[i % 8], now, &error));
+        report("date_parse", n);
+
+        BENCH(3, , for (int i = 0; i < n; i++) sink += parse_date(formatted));
+        report("parse_date", n);
+        (void) sink;
+}
+
+/* Conversions between times and local dates, by the C library and by
+ * tz.h, over times of the next two years. Both have to agree */
+static void
+bench_tz(void)
+{
+        const int n = 1000000;
+        time_t now = time(NULL);
+        time_t *times;
+        struct tm *tms;
+        struct tm tm;
+        volatile long sink = 0;
+
+        times = malloc(sizeof *times * n);
+        tms = malloc(sizeof *tms * n);
+        assert(times && tms);
+        for (int i = 0; i < n; i++) {
+                times[i] = now + (time_t) i * 63 % (2 * 366 * 86400);
+                tz_localtime(&times[i], &tms[i]);
+                tms[i].tm_isdst = -1;
+        }
+
+        BENCH(3, , for (int i = 0; i < n; i++) sink += localtime_r(&times[i], &tm)->tm_mday);
+        report("localtime_r", n);
+
+        BENCH(3, , for (int i = 0; i < n; i++) sink += tz_localtime(&times[i], &tm)->tm_mday);
+        report("tz_localtime", n);
+
+        BENCH(3, , for (int i = 0; i < n; i++) sink += (tm = tms[i], mktime(&tm)));
+        report("mktime", n);
+
+        BENCH(3, , for (int i = 0; i < n; i++) sink += (tm = tms[i], tz_mktime(&tm)));
+        report("tz_mktime", n);
+
+        for (int i = 0; i < n; i += 997) {
+                struct tm a, b;
+                localtime_r(&times[i], &a);
+                tz_localtime(&times[i], &b);
+                assert(a.tm_hour == b.tm_hour && a.tm_mday == b.tm_mday && a.tm_yday == b.tm_yday &&
+                       a.tm_isdst == b.tm_isdst && a.tm_gmtoff == b.tm_gmtoff);
+                a = b = tms[i];
+                assert(mktime(&a) == tz_mktime(&b) && a.tm_wday == b.tm_wday);
+        }
+        free(tms);
+        free(times);
+        (void) sink;
+}
+
+/* A browser request, parsed whole and as if each byte came in a read */
+static void
+bench_http(void)
+{
+        static const char req[] =
+                "GET /list/work/api/search?q=desc+99&x=%C3%B1 HTTP/1.1\r\n"
+                "Host: 127.0.0.1:5002\r\n"
+                "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 Firefox/128.0\r\n"
+                "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+                "Accept-Language: en-US,en;q=0.5\r\n"
+                "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+                "Connection: keep-alive\r\n"
+                "Upgrade-Insecure-Requests: 1\r\n"
+                "If-Modified-Since: Mon, 19 Oct 2026 01:17:53 GMT\r\n"
+                "\r\n";
+        const int n = 100000;
+        volatile long sink = 0;
+        char query[64];
+        Http_Request r;
+
+        BENCH(3, , for (int i = 0; i < n; i++) {
+                http_init(&r);
+                sink += http_parse(&r, req, sizeof req - 1);
+                sink += http_query(&r, req, "q", query, sizeof query);
+        });
+        assert(r.head_len == sizeof req - 1 && strcmp(query, "desc 99") == 0);
+        report("http_parse", n);
+
+        BENCH(3, , for (int i = 0; i < n / 100; i++) {
+                http_init(&r);
+                for (size_t len = 1; len <= sizeof req - 1; len++)
+                        sink += http_parse(&r, req, len);
+        });
+        assert(r.head_len == sizeof req - 1);
+        report("http_parse_bytewise", n / 100);
+        (void) sink;
+}
+
+static void
+archived_free(Archived_da *found)
+{
+        for_da_each(e, *found)
+        {
+                free(e->task.name);
+                free(e->task.desc);
+        }
+        da_destroy(found);
+}
+
+/* Read back done tasks from the archive, as -history. Descriptions are
+ * longer than a gzgets() buffer and have '[' and spaces inside, so a line
+ * read in pieces would be parsed as other tasks and fields */
+static void
+bench_archive(void)
+{
+        char dir[] = "/tmp/todo-bench-archive-XXXXXX";
+        char path[PATH_MAX];
+        char desc[1000];
+        const int n = 10000;
+        time_t from = time(NULL);
+        Archived_da found = { 0 };
+        Store s = { 0 };
+        int partitions;
+
+        assert(mkdtemp(dir));
+        for (size_t i = 0; i < sizeof desc - 1; i++)
+                desc[i] = i % 127 == 1 ? '[' : i % 61 == 0 ? ' ' : 'x';
+        desc[sizeof desc - 1] = 0;
+
+        s.archive.dir = dir;
+        for (int i = 0; i < n; i++)
+                store_add(&s, (Task) { .due = from, .name = strdup("task"), .desc = strdup(desc) });
+        while (s.size)
+                store_complete(&s, s.size - 1);
+        archive_flush(&s);
+        archive_path(path, sizeof path, dir, s.archive.month);
+
+        BENCH(3, archived_free(&found), found = archive_read(dir, from, time(NULL), &partitions));
+        assert(found.size == n);
+        for_da_each(e, found)
+                assert(strcmp(e->task.desc, desc) == 0);
+        archived_free(&found);
+        report("archive_read", n);
+
+        store_destroy(&s);
+        unlink(path);
+        rmdir(dir);
+}
+
+int
+main(int argc, char *argv[])
+{
+        static bool quiet_flag = true;
+        static char *bench_out = BENCH_FILE;
+        static char *bench_assets = ".";
+        static char *bench_datetime_format = DATETIME_FORMAT;
+        int max = argc > 1 ? atoi(argv[1]) : 1000000;
+
+        quiet = &quiet_flag;
+        out_file = &bench_out;
+        assets_dir = &bench_assets;
+        datetime_format = &bench_datetime_format;
+
+        printf("op,tasks,seconds,ns_per_task\n");
+        bench_dates();
+        bench_tz();
+        bench_http();
+        bench_archive();
+        for (int size = 1000; size <= max; size *= 10)
+                bench_size(size);
+
+        destroy_all();
+        unlink(BENCH_FILE);
+        return 0;
+}
@@ -0,0 +1,373 @@
+#ifndef DATE_H_
+#define DATE_H_
+
+/* date.h -- date expressions
+ *
+ * Author: Hugo Coto Florez
+ * Repo: https://github.com/hugootoflorez/todo
+ * License: licenseless
+ *
+ * date_parse() reads a date expression in a single pass over the text,
+ * relative to a given time. Expressions are made of parts:
+ *
+ *   now, today, tomorrow, yesterday
+ *   mon .. sun                   the next one, today included
+ *   next mon .. sun              the one after that
+ *   +N, -N                       N days from today
+ *   +N unit, -N unit, in N unit  unit: min, h, d, w, mo, y (or in full)
+ *   YYYY-MM-DD, DD/MM, DD/MM/YYYY, DD
+ *   HH:MM[:SS], H[:MM]am, H[:MM]pm, noon, midnight, eod
+ *
+ * that can be combined, as "fri 17:00" or "+1w 9am". Dates without time
+ * are due at 23:59:59, and times without date are today. Offsets in
+ * hours and minutes are from the time given, the others from its date.
+ *
+ * Usage:
+ *   due = date_parse("next fri 17:00", time(NULL), &error);
+ */
+
+#include <time.h>
+
+/* Parse SRC relative to NOW. Returns the time, or -1 and an error message
+ * in *ERROR */
+time_t date_parse(const char *src, time_t now, const char **error);
+
+#endif // DATE_H_
+
+#ifdef DATE_IMPLEMENTATION
+
+#include <stdbool.h>
+#include <string.h>
+
+enum date_unit {
+        DATE_NO_UNIT = 0,
+        DATE_MINUTES,
+        DATE_HOURS,
+        DATE_DAYS,
+        DATE_WEEKS,
+        DATE_MONTHS,
+        DATE_YEARS,
+};
+
+static const struct {
+        const char *word;
+        enum date_unit unit;
+} date_units[] = {
+        { "m", DATE_MINUTES },
+        { "min", DATE_MINUTES },
+        { "mins", DATE_MINUTES },
+        { "minute", DATE_MINUTES },
+        { "minutes", DATE_MINUTES },
+        { "h", DATE_HOURS },
+        { "hour", DATE_HOURS },
+        { "hours", DATE_HOURS },
+        { "d", DATE_DAYS },
+        { "day", DATE_DAYS },
+        { "days", DATE_DAYS },
+        { "w", DATE_WEEKS },
+        { "week", DATE_WEEKS },
+        { "weeks", DATE_WEEKS },
+        { "mo", DATE_MONTHS },
+        { "month", DATE_MONTHS },
+        { "months", DATE_MONTHS },
+        { "y", DATE_YEARS },
+        { "year", DATE_YEARS },
+        { "years", DATE_YEARS },
+};
+
+static const char *date_weekdays[] = {
+        "sunday", "monday", "tuesday", "wednesday", "thursday", "friday", "saturday",
+};
+
+/* Day of the week of the date of T, that earlier parts may have moved
+ * without updating tm_wday */
+static int
+date_wday(const struct tm *t)
+{
+        struct tm d = *t;
+
+        /* Noon is never skipped by a change of the offset */
+        d.tm_hour = 12;
+        d.tm_min = d.tm_sec = 0;
+        d.tm_isdst = -1;
+        mktime(&d);
+        return d.tm_wday;
+}
+
+/* Read a lowercase word of at most SIZE - 1 letters. Returns its length,
+ * or 0 if there is no word or it is longer */
+static int
+date_word(const char **c, char *word, int size)
+{
+        int n = 0;
+        for (; (**c | 0x20) >= 'a' && (**c | 0x20) <= 'z'; ++*c) {
+                if (n == size - 1)
+                        return 0;
+                word[n++] = **c | 0x20;
+        }
+        word[n] = 0;
+        return n;
+}
+
+/* Read a number of at most 9 digits. Returns the number of digits */
+static int
+date_number(const char **c, long *n)
+{
+        int digits = 0;
+        for (*n = 0; **c >= '0' && **c <= '9'; ++*c) {
+                if (++digits > 9)
+                        return 0;
+                *n = *n * 10 + (**c - '0');
+        }
+        return digits;
+}
+
+static enum date_unit
+date_unit(const char *word)
+{
+        for (size_t i = 0; i < sizeof date_units / sizeof *date_units; i++)
+                if (!strcmp(date_units[i].word, word))
+                        return date_units[i].unit;
+        return DATE_NO_UNIT;
+}
+
+/* Day of the week of WORD, as tm_wday, or -1. Names can be cut to three
+ * letters */
+static int
+date_weekday(const char *word, int len)
+{
+        if (len < 3)
+                return -1;
+        for (int i = 0; i < 7; i++)
+                if (!strncmp(date_weekdays[i], word, len))
+                        return i;
+        return -1;
+}
+
+/* Read the unit after a number, glued to it or after spaces */
+static enum date_unit
+date_read_unit(const char **c)
+{
+        const char *p = *c + strspn(*c, " \t");
+        char word[16];
+        enum date_unit unit;
+
+        if (!date_word(&p, word, sizeof word) || !(unit = date_unit(word)))
+                return DATE_NO_UNIT;
+        *c = p;
+        return unit;
+}
+
+static void
+date_add(struct tm *t, enum date_unit unit, long n)
+{
+        switch (unit) {
+        case DATE_MINUTES:
+                t->tm_min += n;
+                break;
+        case DATE_HOURS:
+                t->tm_hour += n;
+                break;
+        case DATE_DAYS:
+                t->tm_mday += n;
+                break;
+        case DATE_WEEKS:
+                t->tm_mday += 7 * n;
+                break;
+        case DATE_MONTHS:
+                t->tm_mon += n;
+                break;
+        case DATE_YEARS:
+                t->tm_year += n;
+                break;
+        default:
+                break;
+        }
+}
+
+time_t
+date_parse(const char *src, time_t now, const char **error)
+{
+        const char *c = src;
+        const char *p;
+        struct tm t;
+        bool has_date = false;
+        bool has_time = false;
+        bool next = false;
+        bool colon;
+        enum date_unit unit;
+        char word[16];
+        long a, b, y, sec;
+        int len;
+        int sign;
+        int wday;
+
+        localtime_r(&now, &t);
+        *error = NULL;
+
+#define FAIL(msg)              \
+        do {                   \
+                *error = msg;  \
+                return -1;     \
+        } while (0)
+
+        for (;;) {
+                c += strspn(c, " \t\n");
+                if (*c == 0)
+                        break;
+                if (next && !((*c | 0x20) >= 'a' && (*c | 0x20) <= 'z'))
+                        FAIL("expected a day of the week after next");
+
+                /* +N[unit] or -N[unit] */
+                if (*c == '+' || *c == '-') {
+                        sign = *c++ == '-' ? -1 : 1;
+                        if (!date_number(&c, &a))
+                                FAIL("expected a number after the sign");
+                        unit = date_read_unit(&c);
+                        date_add(&t, unit ? unit : DATE_DAYS, sign * a);
+                        if (unit == DATE_MINUTES || unit == DATE_HOURS)
+                                has_time = true;
+                        has_date = true;
+                }
+
+                else if (*c >= '0' && *c <= '9') {
+                        len = date_number(&c, &a);
+                        if (len == 0)
+                                FAIL("number too long");
+
+                        /* YYYY-MM-DD */
+                        if (*c == '-' && len == 4) {
+                                ++c;
+                                if (!date_number(&c, &b) || *c++ != '-' || !date_number(&c, &y))
+                                        FAIL("expected a date as YYYY-MM-DD");
+                                if (b < 1 || b > 12 || y < 1 || y > 31)
+                                        FAIL("invalid date");
+                                t.tm_year = a - 1900;
+                                t.tm_mon = b - 1;
+                                t.tm_mday = y;
+                                has_date = true;
+                        }
+
+                        /* DD/MM[/YYYY] */
+                        else if (*c == '/') {
+                                ++c;
+                                if (!date_number(&c, &b))
+                                        FAIL("expected a date as DD/MM or DD/MM/YYYY");
+                                if (*c == '/') {
+                                        ++c;
+                                        if (date_number(&c, &y) != 4)
+                                                FAIL("expected a year as YYYY");
+                                        t.tm_year = y - 1900;
+                                }
+                                if (a < 1 || a > 31 || b < 1 || b > 12)
+                                        FAIL("invalid date");
+                                t.tm_mday = a;
+                                t.tm_mon = b - 1;
+                                has_date = true;
+                        }
+
+                        /* HH:MM[:SS] [am|pm], H am|pm, N unit or DD of
+                         * this month */
+                        else {
+                                b = sec = 0;
+                                if ((colon = *c == ':')) {
+                                        ++c;
+                                        if (date_number(&c, &b) != 2)
+                                                FAIL("expected minutes as MM");
+                                        if (*c == ':') {
+                                                ++c;
+                                                if (date_number(&c, &sec) != 2)
+                                                        FAIL("expected seconds as SS");
+                                        }
+                                }
+
+                                /* The word after the number, if any */
+                                p = c + strspn(c, " \t");
+                                len = date_word(&p, word, sizeof word);
+                                if (len && !colon && (unit = date_unit(word))) {
+                                        c = p;
+                                        date_add(&t, unit, a);
+                                        has_time |= unit == DATE_MINUTES || unit == DATE_HOURS;
+                                        has_date = true;
+                                } else if (len && (!strcmp(word, "am") || !strcmp(word, "pm"))) {
+                                        c = p;
+                                        if (a < 1 || a > 12 || b > 59 || sec > 60)
+                                                FAIL("invalid time");
+                                        t.tm_hour = a % 12 + (word[0] == 'p' ? 12 : 0);
+                                        t.tm_min = b;
+                                        t.tm_sec = sec;
+                                        has_time = true;
+                                } else if (colon) {
+                                        if (a > 23 || b > 59 || sec > 60)
+                                                FAIL("invalid time");
+                                        t.tm_hour = a;
+                                        t.tm_min = b;
+                                        t.tm_sec = sec;
+                                        has_time = true;
+                                } else {
+                                        if (a < 1 || a > 31)
+                                                FAIL("invalid day of the month");
+                                        t.tm_mday = a;
+                                        has_date = true;
+                                }
+                        }
+                }
+
+                else {
+                        len = date_word(&c, word, sizeof word);
+                        if (len == 0)
+                                FAIL("unexpected character");
+
+                        if (next && (wday = date_weekday(word, len)) < 0)
+                                FAIL("expected a day of the week after next");
+
+                        if (!strcmp(word, "now")) {
+                                has_date = has_time = true;
+                        } else if (!strcmp(word, "today")) {
+                                has_date = true;
+                        } else if (!strcmp(word, "tomorrow")) {
+                                ++t.tm_mday;
+                                has_date = true;
+                        } else if (!strcmp(word, "yesterday")) {
+                                --t.tm_mday;
+                                has_date = true;
+                        } else if (!strcmp(word, "noon") || !strcmp(word, "midnight") || !strcmp(word, "eod")) {
+                                t.tm_hour = word[0] == 'n' ? 12 : word[0] == 'e' ? 23 : 0;
+                                t.tm_min = t.tm_sec = word[0] == 'e' ? 59 : 0;
+                                has_time = true;
+                        } else if (!strcmp(word, "next")) {
+                                next = true;
+                                continue;
+                        } else if (!strcmp(word, "in")) {
+                                c += strspn(c, " \t");
+                                if (!date_number(&c, &a) || !(unit = date_read_unit(&c)))
+                                        FAIL("expected a number and a unit after in");
+                                date_add(&t, unit, a);
+                                has_time |= unit == DATE_MINUTES || unit == DATE_HOURS;
+                                has_date = true;
+                        } else if ((wday = date_weekday(word, len)) >= 0) {
+                                t.tm_mday += (wday - date_wday(&t) + 7) % 7 + (next ? 7 : 0);
+                                has_date = true;
+                        } else
+                                FAIL("unknown word");
+                        next = false;
+                }
+        }
+
+        if (next)
+                FAIL("expected a day of the week after next");
+        if (!has_date && !has_time)
+                FAIL("empty date");
+
+#undef FAIL
+
+        if (!has_time) {
+                t.tm_hour = 23;
+                t.tm_min = 59;
+                t.tm_sec = 59;
+        }
+        t.tm_isdst = -1;
+        return mktime(&t);
+}
+
+#endif // DATE_IMPLEMENTATION
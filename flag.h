@@ -7,6 +7,11 @@
  *   uint64_t -> int
  *   remove print default values as I use default values to
  *   check if a flag is set
+ *   flags marked with flag_setting() can also be set from the
+ *   environment and from a config file, see flag_parse_env() and
+ *   flag_parse_file(). The command line overrides the environment, that
+ *   overrides the file
+ *   bools also take yes/no and on/off
  */
 
 #ifndef FLAG_H_
@@ -35,7 +40,18 @@ bool *flag_bool(const char *name, bool def, const char *desc);
 int *flag_int(const char *name, int def, const char *desc);
 size_t *flag_size(const char *name, int def, const char *desc);
 char **flag_str(const char *name, const char *def, const char *desc);
+// Mark the flag of VAL as a setting, that can also be set from the
+// environment and the config file, and not only from the command line.
+// Returns VAL, as: port = flag_setting(flag_int("port", 80, "Port"))
+void *flag_setting(void *val);
 bool flag_parse(int argc, char **argv);
+// Set every setting NAME that has an environment variable PREFIX + NAME
+// in uppercase, as TODO_IN_FILE for -in_file. Invalid values are
+// reported to stderr and ignored, so they do not break every command
+bool flag_parse_env(const char *prefix);
+// Set settings from lines "name = value" or "name value" of the file at
+// PATH. Lines starting with # are comments. Bools take true or false
+bool flag_parse_file(const char *path);
 int flag_rest_argc(void);
 char **flag_rest_argv(void);
 void flag_print_error(FILE *stream);
@@ -70,15 +86,29 @@ typedef enum {
         FLAG_ERROR_INVALID_NUMBER,
         FLAG_ERROR_INTEGER_OVERFLOW,
         FLAG_ERROR_INVALID_SIZE_SUFFIX,
+        FLAG_ERROR_INVALID_BOOL,
+        FLAG_ERROR_FILE,
+        FLAG_ERROR_NOT_SETTING,
         COUNT_FLAG_ERRORS,
 } Flag_Error;
 
+// Where the value of a flag comes from. A flag is only set from a source
+// that is at least as important as the one of its value
+typedef enum {
+        FLAG_FROM_DEFAULT = 0,
+        FLAG_FROM_FILE,
+        FLAG_FROM_ENV,
+        FLAG_FROM_ARGS,
+} Flag_Source;
+
 typedef struct {
         Flag_Type type;
         char *name;
         char *desc;
         Flag_Value val;
         Flag_Value def;
+        Flag_Source source;
+        bool setting; // see flag_setting()
 } Flag;
 
 #ifndef FLAGS_CAP
@@ -91,6 +121,7 @@ typedef struct {
 
         Flag_Error flag_error;
         char *flag_error_name;
+        char flag_error_where[256]; // file:line or variable, empty for args
 
         const char *program_name;
 
@@ -122,6 +153,14 @@ flag_name(void *val)
         return flag->name;
 }
 
+void *
+flag_setting(void *val)
+{
+        Flag *flag = (Flag *) ((char *) val - offsetof(Flag, val));
+        flag->setting = true;
+        return val;
+}
+
 bool *
 flag_bool(const char *name, bool def, const char *desc)
 {
@@ -186,6 +225,104 @@ flag_program_name(void)
         return flag_global_context.program_name;
 }
 
+// Set FLAG to the value in ARG, that comes from SOURCE. Returns false on
+// error
+static bool
+flag_set(Flag *flag, char *arg, Flag_Source source)
+{
+        Flag_Context *c = &flag_global_context;
+
+        if (source < flag->source)
+                return true;
+
+        static_assert(COUNT_FLAG_TYPES == 4, "Exhaustive flag type parsing");
+        switch (flag->type) {
+        case FLAG_BOOL: {
+                if (strcmp(arg, "true") == 0 || strcmp(arg, "1") == 0 ||
+                    strcmp(arg, "yes") == 0 || strcmp(arg, "on") == 0) {
+                        flag->val.as_bool = true;
+                } else if (strcmp(arg, "false") == 0 || strcmp(arg, "0") == 0 ||
+                           strcmp(arg, "no") == 0 || strcmp(arg, "off") == 0) {
+                        flag->val.as_bool = false;
+                } else {
+                        c->flag_error = FLAG_ERROR_INVALID_BOOL;
+                        c->flag_error_name = flag->name;
+                        return false;
+                }
+        } break;
+
+        case FLAG_STR: {
+                flag->val.as_str = arg;
+        } break;
+
+        case FLAG_INT: {
+                char *endptr;
+                // TODO: replace strtoull with a custom solution
+                // That way we can get rid of the dependency on errno and static_assert
+                errno = 0;
+                unsigned long long int result = strtoull(arg, &endptr, 10);
+
+                if (*arg == '\0' || *endptr != '\0') {
+                        c->flag_error = FLAG_ERROR_INVALID_NUMBER;
+                        c->flag_error_name = flag->name;
+                        return false;
+                }
+
+                if (result == ULLONG_MAX && errno == ERANGE) {
+                        c->flag_error = FLAG_ERROR_INTEGER_OVERFLOW;
+                        c->flag_error_name = flag->name;
+                        return false;
+                }
+
+                flag->val.as_int = result;
+        } break;
+
+        case FLAG_SIZE: {
+                static_assert(sizeof(unsigned long long int) == sizeof(size_t), "The original author designed this for x86_64 machine with the compiler that expects unsigned long long int and size_t to be the same thing, so they could use strtoull() function to parse it. Please adjust this code for your case and maybe even send the patch to upstream to make it work on a wider range of environments.");
+                char *endptr;
+                // TODO: replace strtoull with a custom solution
+                // That way we can get rid of the dependency on errno and static_assert
+                errno = 0;
+                unsigned long long int result = strtoull(arg, &endptr, 10);
+
+                // TODO: handle more multiplicative suffixes like in dd(1). From the dd(1) man page:
+                // > N and BYTES may be followed by the following
+                // > multiplicative suffixes: c =1, w =2, b =512, kB =1000, K
+                // > =1024, MB =1000*1000, M =1024*1024, xM =M, GB
+                // > =1000*1000*1000, G =1024*1024*1024, and so on for T, P,
+                // > E, Z, Y.
+                if (strcmp(endptr, "K") == 0) {
+                        result *= 1024;
+                } else if (strcmp(endptr, "M") == 0) {
+                        result *= 1024 * 1024;
+                } else if (strcmp(endptr, "G") == 0) {
+                        result *= 1024 * 1024 * 1024;
+                } else if (strcmp(endptr, "") != 0) {
+                        c->flag_error = FLAG_ERROR_INVALID_SIZE_SUFFIX;
+                        c->flag_error_name = flag->name;
+                        // TODO: capability to report what exactly is the wrong suffix
+                        return false;
+                }
+
+                if (result == ULLONG_MAX && errno == ERANGE) {
+                        c->flag_error = FLAG_ERROR_INTEGER_OVERFLOW;
+                        c->flag_error_name = flag->name;
+                        return false;
+                }
+
+                flag->val.as_size = result;
+        } break;
+
+        case COUNT_FLAG_TYPES:
+        default: {
+                assert(0 && "unreachable");
+                exit(69);
+        }
+        }
+        flag->source = source;
+        return true;
+}
+
 bool
 flag_parse(int argc, char **argv)
 {
@@ -218,97 +355,14 @@ flag_parse(int argc, char **argv)
                 bool found = false;
                 for (size_t i = 0; i < c->flags_count; ++i) {
                         if (strcmp(c->flags[i].name, flag) == 0) {
-                                static_assert(COUNT_FLAG_TYPES == 4, "Exhaustive flag type parsing");
-                                switch (c->flags[i].type) {
-                                case FLAG_BOOL: {
-                                        c->flags[i].val.as_bool = true;
-                                } break;
-
-                                case FLAG_STR: {
-                                        if (argc == 0) {
-                                                c->flag_error = FLAG_ERROR_NO_VALUE;
-                                                c->flag_error_name = flag;
-                                                return false;
-                                        }
-                                        char *arg = flag_shift_args(&argc, &argv);
-                                        c->flags[i].val.as_str = arg;
-                                } break;
-
-                                case FLAG_INT: {
-                                        if (argc == 0) {
-                                                c->flag_error = FLAG_ERROR_NO_VALUE;
-                                                c->flag_error_name = flag;
-                                                return false;
-                                        }
-                                        char *arg = flag_shift_args(&argc, &argv);
-
-                                        char *endptr;
-                                        // TODO: replace strtoull with a custom solution
-                                        // That way we can get rid of the dependency on errno and static_assert
-                                        unsigned long long int result = strtoull(arg, &endptr, 10);
-
-                                        if (*endptr != '\0') {
-                                                c->flag_error = FLAG_ERROR_INVALID_NUMBER;
-                                                c->flag_error_name = flag;
-                                                return false;
-                                        }
-
-                                        if (result == ULLONG_MAX && errno == ERANGE) {
-                                                c->flag_error = FLAG_ERROR_INTEGER_OVERFLOW;
-                                                c->flag_error_name = flag;
-                                                return false;
-                                        }
-
-                                        c->flags[i].val.as_int = result;
-                                } break;
-
-                                case FLAG_SIZE: {
-                                        if (argc == 0) {
-                                                c->flag_error = FLAG_ERROR_NO_VALUE;
-                                                c->flag_error_name = flag;
-                                                return false;
-                                        }
-                                        char *arg = flag_shift_args(&argc, &argv);
-
-                                        static_assert(sizeof(unsigned long long int) == sizeof(size_t), "The original author designed this for x86_64 machine with the compiler that expects unsigned long long int and size_t to be the same thing, so they could use strtoull() function to parse it. Please adjust this code for your case and maybe even send the patch to upstream to make it work on a wider range of environments.");
-                                        char *endptr;
-                                        // TODO: replace strtoull with a custom solution
-                                        // That way we can get rid of the dependency on errno and static_assert
-                                        unsigned long long int result = strtoull(arg, &endptr, 10);
-
-                                        // TODO: handle more multiplicative suffixes like in dd(1). From the dd(1) man page:
-                                        // > N and BYTES may be followed by the following
-                                        // > multiplicative suffixes: c =1, w =2, b =512, kB =1000, K
-                                        // > =1024, MB =1000*1000, M =1024*1024, xM =M, GB
-                                        // > =1000*1000*1000, G =1024*1024*1024, and so on for T, P,
-                                        // > E, Z, Y.
-                                        if (strcmp(endptr, "K") == 0) {
-                                                result *= 1024;
-                                        } else if (strcmp(endptr, "M") == 0) {
-                                                result *= 1024 * 1024;
-                                        } else if (strcmp(endptr, "G") == 0) {
-                                                result *= 1024 * 1024 * 1024;
-                                        } else if (strcmp(endptr, "") != 0) {
-                                                c->flag_error = FLAG_ERROR_INVALID_SIZE_SUFFIX;
-                                                c->flag_error_name = flag;
-                                                // TODO: capability to report what exactly is the wrong suffix
-                                                return false;
-                                        }
-
-                                        if (result == ULLONG_MAX && errno == ERANGE) {
-                                                c->flag_error = FLAG_ERROR_INTEGER_OVERFLOW;
-                                                c->flag_error_name = flag;
-                                                return false;
-                                        }
-
-                                        c->flags[i].val.as_size = result;
-                                } break;
-
-                                case COUNT_FLAG_TYPES:
-                                default: {
-                                        assert(0 && "unreachable");
-                                        exit(69);
-                                }
+                                if (c->flags[i].type == FLAG_BOOL) {
+                                        flag_set(&c->flags[i], "true", FLAG_FROM_ARGS);
+                                } else if (argc == 0) {
+                                        c->flag_error = FLAG_ERROR_NO_VALUE;
+                                        c->flag_error_name = flag;
+                                        return false;
+                                } else if (!flag_set(&c->flags[i], flag_shift_args(&argc, &argv), FLAG_FROM_ARGS)) {
+                                        return false;
                                 }
 
                                 found = true;
@@ -327,6 +381,99 @@ flag_parse(int argc, char **argv)
         return true;
 }
 
+bool
+flag_parse_env(const char *prefix)
+{
+        Flag_Context *c = &flag_global_context;
+        char var[256];
+        char *val;
+        size_t n;
+
+        for (size_t i = 0; i < c->flags_count; ++i) {
+                if (!c->flags[i].setting)
+                        continue;
+                n = snprintf(var, sizeof(var), "%s%s", prefix, c->flags[i].name);
+                if (n >= sizeof(var))
+                        continue;
+                for (char *v = var; *v; ++v) {
+                        if (*v >= 'a' && *v <= 'z')
+                                *v -= 'a' - 'A';
+                }
+                if ((val = getenv(var)) == NULL)
+                        continue;
+                if (!flag_set(&c->flags[i], val, FLAG_FROM_ENV)) {
+                        fprintf(stderr, "WARNING: %s: invalid value for -%s, ignored\n", var, c->flags[i].name);
+                        c->flag_error = FLAG_NO_ERROR;
+                }
+        }
+        return true;
+}
+
+bool
+flag_parse_file(const char *path)
+{
+        Flag_Context *c = &flag_global_context;
+        char *line = NULL;
+        size_t cap = 0;
+        size_t lineno = 0;
+        bool ok = true;
+        char *name;
+        char *val;
+        char *end;
+        FILE *f;
+
+        if ((f = fopen(path, "r")) == NULL) {
+                c->flag_error = FLAG_ERROR_FILE;
+                c->flag_error_name = strerror(errno);
+                snprintf(c->flag_error_where, sizeof(c->flag_error_where), "%s", path);
+                return false;
+        }
+
+        while (ok && getline(&line, &cap, f) > 0) {
+                ++lineno;
+                name = line + strspn(line, " \t");
+                if (*name == '#' || *name == '\n' || *name == '\0')
+                        continue;
+
+                val = name + strcspn(name, " \t=\n");
+                end = val + strspn(val, " \t");
+                if (*end == '=')
+                        end += 1 + strspn(end + 1, " \t");
+                *val = '\0';
+                val = end;
+                end = val + strlen(val);
+                while (end > val && (end[-1] == '\n' || end[-1] == ' ' || end[-1] == '\t'))
+                        *--end = '\0';
+
+                ok = false;
+                snprintf(c->flag_error_where, sizeof(c->flag_error_where), "%s:%zu", path, lineno);
+                c->flag_error = FLAG_ERROR_UNKNOWN;
+                c->flag_error_name = NULL;
+                for (size_t i = 0; i < c->flags_count; ++i) {
+                        if (strcmp(c->flags[i].name, name) == 0) {
+                                if (!c->flags[i].setting) {
+                                        c->flag_error = FLAG_ERROR_NOT_SETTING;
+                                        c->flag_error_name = c->flags[i].name;
+                                        break;
+                                }
+                                // NOTE: values live as long as the flags
+                                ok = flag_set(&c->flags[i], strdup(val), FLAG_FROM_FILE);
+                                break;
+                        }
+                }
+                if (!ok && c->flag_error == FLAG_ERROR_UNKNOWN)
+                        c->flag_error_name = strdup(name);
+        }
+
+        if (ok) {
+                c->flag_error = FLAG_NO_ERROR;
+                c->flag_error_where[0] = '\0';
+        }
+        free(line);
+        fclose(f);
+        return ok;
+}
+
 void
 flag_print_options(FILE *stream)
 {
@@ -365,26 +512,40 @@ void
 flag_print_error(FILE *stream)
 {
         Flag_Context *c = &flag_global_context;
-        static_assert(COUNT_FLAG_ERRORS == 6, "Exhaustive flag error printing");
+        static_assert(COUNT_FLAG_ERRORS == 9, "Exhaustive flag error printing");
+        if (c->flag_error_where[0] != '\0') {
+                fprintf(stream, "ERROR: %s: ", c->flag_error_where);
+        } else if (c->flag_error != FLAG_NO_ERROR) {
+                fprintf(stream, "ERROR: ");
+        }
         switch (c->flag_error) {
         case FLAG_NO_ERROR:
                 // NOTE: don't call flag_print_error() if flag_parse() didn't return false, okay? ._.
                 fprintf(stream, "Operation Failed Successfully! Please tell the developer of this software that they don't know what they are doing! :)");
                 break;
         case FLAG_ERROR_UNKNOWN:
-                fprintf(stream, "ERROR: -%s: unknown flag\n", c->flag_error_name);
+                fprintf(stream, "-%s: unknown flag\n", c->flag_error_name);
                 break;
         case FLAG_ERROR_NO_VALUE:
-                fprintf(stream, "ERROR: -%s: no value provided\n", c->flag_error_name);
+                fprintf(stream, "-%s: no value provided\n", c->flag_error_name);
                 break;
         case FLAG_ERROR_INVALID_NUMBER:
-                fprintf(stream, "ERROR: -%s: invalid number\n", c->flag_error_name);
+                fprintf(stream, "-%s: invalid number\n", c->flag_error_name);
                 break;
         case FLAG_ERROR_INTEGER_OVERFLOW:
-                fprintf(stream, "ERROR: -%s: integer overflow\n", c->flag_error_name);
+                fprintf(stream, "-%s: integer overflow\n", c->flag_error_name);
                 break;
         case FLAG_ERROR_INVALID_SIZE_SUFFIX:
-                fprintf(stream, "ERROR: -%s: invalid size suffix\n", c->flag_error_name);
+                fprintf(stream, "-%s: invalid size suffix\n", c->flag_error_name);
+                break;
+        case FLAG_ERROR_INVALID_BOOL:
+                fprintf(stream, "-%s: expected true or false\n", c->flag_error_name);
+                break;
+        case FLAG_ERROR_FILE:
+                fprintf(stream, "%s\n", c->flag_error_name);
+                break;
+        case FLAG_ERROR_NOT_SETTING:
+                fprintf(stream, "-%s: only allowed in the command line\n", c->flag_error_name);
                 break;
         case COUNT_FLAG_ERRORS:
         default:
@@ -400,6 +561,9 @@ flag_print_error(FILE *stream)
 
      1.0.0 (2025-03-03) Initial release
                         Save program_name in the context
+           (local)      flag_parse_env() and flag_parse_file()
+           (local)      flag_setting(), only settings are read from the
+                        environment and the config file
 
 */
 
@@ -0,0 +1,512 @@
+#ifndef FORMATS_H_
+#define FORMATS_H_
+
+/* formats.h -- streaming CSV, JSON lines and iCalendar records
+ *
+ * Author: Hugo Coto Florez
+ * Repo: https://github.com/hugootoflorez/todo
+ * License: licenseless
+ *
+ * Readers return one record at a time from a FILE, so files of any size
+ * are read with the memory of their longest record. Returned strings
+ * point into the reader buffers and are valid until the next read.
+ *
+ * CSV follows RFC 4180: fields can be quoted, and quoted fields can have
+ * commas, newlines and quotes written as "". JSON lines have a flat
+ * object per line: values can be strings, numbers, true, false, null or
+ * arrays of them, that are joined with commas. iCalendar lines are
+ * unfolded and split in name, parameters and value.
+ *
+ * Usage:
+ *   Format_Reader r = { .f = stdin };
+ *   char *fields[8];
+ *   while ((n = csv_read(&r, fields, 8)) >= 0)
+ *           ...
+ *   format_reader_destroy(&r);
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+
+typedef struct {
+        FILE *f;
+        long lineno; /* line where the last record starts */
+        char *buf; /* decoded record */
+        size_t cap;
+        char *line; /* last line read */
+        size_t line_cap;
+        long lines; /* lines read */
+        bool pending; /* LINE is the start of the next record */
+} Format_Reader;
+
+typedef struct {
+        char *key;
+        char *value; /* NULL for json null */
+} Format_Field;
+
+/* Read a CSV record into FIELDS, at most MAX. Returns the number of
+ * fields, or -1 at the end of the file */
+int csv_read(Format_Reader *r, char **fields, int max);
+/* Read a JSON lines object into FIELDS, at most MAX. Returns the number of
+ * fields, 0 for blank lines or -1 at the end of the file. On syntax
+ * errors returns 0 and sets *ERROR, that is NULL otherwise */
+int ndjson_read(Format_Reader *r, Format_Field *fields, int max, const char **error);
+/* Read an iCalendar content line. PARAMS are the parameters, without the
+ * first ';', or empty if there are none. Returns false at the end of the
+ * file */
+bool ics_read(Format_Reader *r, char **name, char **params, char **value);
+/* Decode the escapes of an iCalendar TEXT value in place */
+char *ics_unescape(char *value);
+void format_reader_destroy(Format_Reader *r);
+
+/* Write a CSV field, quoted if needed. STR can be NULL */
+void csv_write(FILE *f, const char *str, bool last);
+/* Write STR as a json string, or null if STR is NULL */
+void json_write_str(FILE *f, const char *str);
+/* Write the content line NAME:VALUE, folded at 75 bytes. VALUE is escaped
+ * if it is TEXT */
+void ics_write(FILE *f, const char *name, const char *value, bool text);
+
+#endif // FORMATS_H_
+
+#ifdef FORMATS_IMPLEMENTATION
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Read a line into R->LINE, without the line terminator. Returns its
+ * length or -1 at the end of the file */
+static long
+format_getline(Format_Reader *r)
+{
+        ssize_t n;
+
+        if (r->pending) {
+                r->pending = false;
+                return strlen(r->line);
+        }
+        if ((n = getline(&r->line, &r->line_cap, r->f)) < 0)
+                return -1;
+        ++r->lines;
+        while (n > 0 && (r->line[n - 1] == '\n' || r->line[n - 1] == '\r'))
+                r->line[--n] = 0;
+        return n;
+}
+
+/* Make room for LEN bytes in R->BUF */
+static void
+format_reserve(Format_Reader *r, size_t len)
+{
+        if (len <= r->cap)
+                return;
+        r->cap = len > r->cap * 2 ? len : r->cap * 2;
+        r->buf = realloc(r->buf, r->cap);
+}
+
+int
+csv_read(Format_Reader *r, char **fields, int max)
+{
+        size_t len = 0;
+        bool quoted = false;
+        long n;
+        char *c;
+        char *w;
+        int count = 0;
+
+        /* Join lines while a quoted field is open */
+        do {
+                if ((n = format_getline(r)) < 0) {
+                        if (len == 0)
+                                return -1;
+                        break;
+                }
+                if (len == 0)
+                        r->lineno = r->lines;
+                else
+                        r->buf[len++] = '\n';
+                format_reserve(r, len + n + 2);
+                memcpy(r->buf + len, r->line, n + 1);
+                for (c = r->line; *c; c++)
+                        quoted ^= *c == '"';
+                len += n;
+        } while (quoted);
+
+        /* Split in place, the decoded field is never longer */
+        for (c = w = r->buf; count < max;) {
+                fields[count++] = w;
+                if (*c == '"') {
+                        for (++c; *c; ++c) {
+                                if (*c == '"' && c[1] != '"')
+                                        break;
+                                if (*c == '"')
+                                        ++c;
+                                *w++ = *c;
+                        }
+                        if (*c == '"')
+                                ++c;
+                }
+                while (*c && *c != ',')
+                        *w++ = *c++;
+                if (*c != ',') {
+                        *w = 0;
+                        break;
+                }
+                ++c;
+                *w++ = 0;
+        }
+        return count;
+}
+
+/* Append the UTF-8 encoding of CP to *W */
+static void
+format_utf8(char **w, unsigned long cp)
+{
+        unsigned char *o = (unsigned char *) *w;
+        if (cp < 0x80)
+                *o++ = cp;
+        else if (cp < 0x800) {
+                *o++ = 0xc0 | cp >> 6;
+                *o++ = 0x80 | (cp & 0x3f);
+        } else if (cp < 0x10000) {
+                *o++ = 0xe0 | cp >> 12;
+                *o++ = 0x80 | (cp >> 6 & 0x3f);
+                *o++ = 0x80 | (cp & 0x3f);
+        } else {
+                *o++ = 0xf0 | cp >> 18;
+                *o++ = 0x80 | (cp >> 12 & 0x3f);
+                *o++ = 0x80 | (cp >> 6 & 0x3f);
+                *o++ = 0x80 | (cp & 0x3f);
+        }
+        *w = (char *) o;
+}
+
+static int
+format_hex4(const char *c, unsigned long *cp)
+{
+        char hex[5] = { 0 };
+        for (int i = 0; i < 4; i++)
+                if (!isxdigit((unsigned char) (hex[i] = c[i])))
+                        return 0;
+        *cp = strtoul(hex, NULL, 16);
+        return 1;
+}
+
+/* Decode the json string at *C, after the opening quote, into *W. Returns
+ * false on error. \u0000 and lone surrogates are errors, as they can not
+ * be in a C string of valid UTF-8 */
+static bool
+json_read_str(const char **c, char **w)
+{
+        unsigned long cp;
+        unsigned long lo;
+        const char *p = *c;
+
+        for (; *p && *p != '"'; p++) {
+                if (*p != '\\') {
+                        *(*w)++ = *p;
+                        continue;
+                }
+                switch (*++p) {
+                case '"':
+                case '\\':
+                case '/':
+                        *(*w)++ = *p;
+                        break;
+                case 'b':
+                        *(*w)++ = '\b';
+                        break;
+                case 'f':
+                        *(*w)++ = '\f';
+                        break;
+                case 'n':
+                        *(*w)++ = '\n';
+                        break;
+                case 'r':
+                        *(*w)++ = '\r';
+                        break;
+                case 't':
+                        *(*w)++ = '\t';
+                        break;
+                case 'u':
+                        if (!format_hex4(p + 1, &cp))
+                                return false;
+                        p += 4;
+                        /* Surrogate pair */
+                        if (cp >= 0xd800 && cp < 0xdc00 && p[1] == '\\' && p[2] == 'u' &&
+                            format_hex4(p + 3, &lo) && lo >= 0xdc00 && lo < 0xe000) {
+                                cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+                                p += 6;
+                        }
+                        if (cp == 0 || (cp >= 0xd800 && cp < 0xe000))
+                                return false;
+                        format_utf8(w, cp);
+                        break;
+                default:
+                        return false;
+                }
+        }
+        if (*p != '"')
+                return false;
+        *c = p + 1;
+        return true;
+}
+
+/* Decode the scalar json value at *C into *W. Returns false on error, and
+ * sets ERROR to a message */
+static bool
+json_read_scalar(const char **c, char **w, bool *null, const char **error)
+{
+        char *end;
+        size_t n;
+
+        *null = false;
+        if (**c == '"') {
+                ++*c;
+                if (!json_read_str(c, w)) {
+                        *error = "invalid string";
+                        return false;
+                }
+                return true;
+        }
+        if (strncmp(*c, "null", 4) == 0) {
+                *null = true;
+                *c += 4;
+                return true;
+        }
+        if (strncmp(*c, "true", 4) == 0)
+                n = 4;
+        else if (strncmp(*c, "false", 5) == 0)
+                n = 5;
+        else if (**c == '-' || isdigit((unsigned char) **c)) {
+                strtod(*c, &end);
+                n = end - *c;
+        } else
+                n = 0;
+        /* strtod() also reads hex, inf and nan, that are not json */
+        if (n == 0 || strspn(*c, "+-0123456789.eEtruefals") < n) {
+                *error = "invalid value";
+                return false;
+        }
+        memcpy(*w, *c, n);
+        *w += n;
+        *c += n;
+        return true;
+}
+
+int
+ndjson_read(Format_Reader *r, Format_Field *fields, int max, const char **error)
+{
+        Format_Field extra;
+        Format_Field *field = NULL;
+        const char *c;
+        char *w;
+        bool null;
+        int count = 0;
+        int items;
+        long n;
+
+        *error = NULL;
+        if ((n = format_getline(r)) < 0)
+                return -1;
+        r->lineno = r->lines;
+        /* Decoded keys and values are never longer than the line */
+        format_reserve(r, n + 1);
+        w = r->buf;
+
+#define SKIP_SPACE() (c += strspn(c, " \t"))
+#define FAIL(msg)              \
+        do {                   \
+                *error = msg;  \
+                return 0;      \
+        } while (0)
+
+        c = r->line;
+        if (*SKIP_SPACE() == 0)
+                return 0;
+        if (*c++ != '{')
+                FAIL("expected an object");
+
+        while (*SKIP_SPACE() != '}') {
+                if (field && *c++ != ',')
+                        FAIL("expected , or }");
+                if (*SKIP_SPACE() != '"')
+                        FAIL("expected a key");
+                ++c;
+                /* Extra fields are read and ignored */
+                field = count < max ? &fields[count++] : &extra;
+                field->key = w;
+                if (!json_read_str(&c, &w))
+                        FAIL("invalid string");
+                *w++ = 0;
+                if (*SKIP_SPACE() != ':')
+                        FAIL("expected :");
+                ++c;
+                SKIP_SPACE();
+
+                field->value = w;
+                if (*c == '[') {
+                        /* Arrays are joined with commas */
+                        for (++c, items = 0; *SKIP_SPACE() != ']'; items++) {
+                                if (items) {
+                                        if (*c++ != ',')
+                                                FAIL("expected , or ]");
+                                        SKIP_SPACE();
+                                        *w++ = ',';
+                                }
+                                if (!json_read_scalar(&c, &w, &null, error))
+                                        return 0;
+                        }
+                        ++c;
+                } else if (*c == '{')
+                        FAIL("nested objects are not supported");
+                else if (!json_read_scalar(&c, &w, &null, error))
+                        return 0;
+                else if (null)
+                        field->value = NULL;
+                *w++ = 0;
+        }
+        ++c;
+        if (c[strspn(c, " \t")])
+                FAIL("unexpected text after the object");
+
+#undef FAIL
+#undef SKIP_SPACE
+        return count;
+}
+
+bool
+ics_read(Format_Reader *r, char **name, char **params, char **value)
+{
+        size_t len;
+        long n;
+        char *c;
+        bool quoted = false;
+
+        do {
+                if ((n = format_getline(r)) < 0)
+                        return false;
+        } while (n == 0);
+        r->lineno = r->lines;
+        format_reserve(r, n + 2);
+        memcpy(r->buf, r->line, n + 1);
+        len = n;
+
+        /* Unfold continuation lines, that start with a space or a tab */
+        while ((n = format_getline(r)) >= 0) {
+                if (r->line[0] != ' ' && r->line[0] != '\t') {
+                        r->pending = true;
+                        break;
+                }
+                format_reserve(r, len + n + 1);
+                memcpy(r->buf + len, r->line + 1, n);
+                len += n - 1;
+                r->buf[len] = 0;
+        }
+
+        /* NAME[;PARAM=VALUE...]:VALUE. Parameter values can be quoted */
+        *name = r->buf;
+        for (c = r->buf; *c && (quoted || *c != ':'); c++)
+                quoted ^= *c == '"';
+        *value = *c ? c + 1 : c;
+        *c = 0;
+        *params = *name + strcspn(*name, ";");
+        if (**params)
+                *(*params)++ = 0;
+        return true;
+}
+
+char *
+ics_unescape(char *value)
+{
+        char *w = value;
+        for (char *c = value; *c; c++) {
+                if (*c == '\\' && c[1]) {
+                        ++c;
+                        *w++ = *c == 'n' || *c == 'N' ? '\n' : *c;
+                } else
+                        *w++ = *c;
+        }
+        *w = 0;
+        return value;
+}
+
+void
+format_reader_destroy(Format_Reader *r)
+{
+        free(r->buf);
+        free(r->line);
+        r->buf = r->line = NULL;
+        r->cap = r->line_cap = 0;
+}
+
+void
+csv_write(FILE *f, const char *str, bool last)
+{
+        if (str && str[strcspn(str, ",\"\r\n")]) {
+                fputc('"', f);
+                for (; *str; str++) {
+                        if (*str == '"')
+                                fputc('"', f);
+                        fputc(*str, f);
+                }
+                fputc('"', f);
+        } else if (str)
+                fputs(str, f);
+        fputc(last ? '\n' : ',', f);
+}
+
+void
+json_write_str(FILE *f, const char *str)
+{
+        if (str == NULL) {
+                fputs("null", f);
+                return;
+        }
+        fputc('"', f);
+        for (; *str; str++) {
+                if (*str == '"' || *str == '\\')
+                        fprintf(f, "\\%c", *str);
+                else if ((unsigned char) *str < 0x20)
+                        fprintf(f, "\\u%04x", *str);
+                else
+                        fputc(*str, f);
+        }
+        fputc('"', f);
+}
+
+/* Write the byte C of a content line that already has *COL bytes,
+ * folding it first if needed. UTF-8 sequences are not split */
+static void
+ics_putc(FILE *f, char c, int *col)
+{
+        if (*col >= 75 && ((unsigned char) c & 0xc0) != 0x80) {
+                fputs("\r\n ", f);
+                *col = 1;
+        }
+        fputc(c, f);
+        ++*col;
+}
+
+void
+ics_write(FILE *f, const char *name, const char *value, bool text)
+{
+        int col = 0;
+
+        for (const char *c = name; *c; c++)
+                ics_putc(f, *c, &col);
+        ics_putc(f, ':', &col);
+        for (const char *c = value; *c; c++) {
+                if (text && *c == '\n') {
+                        ics_putc(f, '\\', &col);
+                        ics_putc(f, 'n', &col);
+                        continue;
+                }
+                if (text && (*c == '\\' || *c == ';' || *c == ','))
+                        ics_putc(f, '\\', &col);
+                ics_putc(f, *c, &col);
+        }
+        fputs("\r\n", f);
+}
+
+#endif // FORMATS_IMPLEMENTATION
@@ -0,0 +1,71 @@
+#ifndef FUZZ_H_
+#define FUZZ_H_
+
+/* fuzz.h -- driver of the fuzz harnesses
+ *
+ * Author: Hugo Coto Florez
+ * Repo: https://github.com/hugootoflorez/todo
+ * License: licenseless
+ *
+ * Harnesses define LLVMFuzzerTestOneInput(), as libFuzzer expects. Built
+ * with -DFUZZ_LIBFUZZER libFuzzer provides main(). If not, this main()
+ * runs it once with stdin, as AFL and crash reproduction need, or once
+ * with each file given, to run a corpus.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+#ifndef FUZZ_LIBFUZZER
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Run the harness with the whole content of F */
+static int
+fuzz_run(FILE *f)
+{
+        uint8_t *data = NULL;
+        size_t size = 0;
+        size_t cap = 0;
+        size_t n;
+
+        do {
+                if (size == cap) {
+                        cap = cap ? cap * 2 : 4096;
+                        if ((data = realloc(data, cap)) == NULL)
+                                return 1;
+                }
+                size += n = fread(data + size, 1, cap - size, f);
+        } while (n > 0);
+
+        LLVMFuzzerTestOneInput(data, size);
+        free(data);
+        return ferror(f) != 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+        FILE *f;
+        int status = 0;
+
+        if (argc < 2)
+                return fuzz_run(stdin);
+        for (int i = 1; i < argc; i++) {
+                if ((f = fopen(argv[i], "rb")) == NULL) {
+                        perror(argv[i]);
+                        status = 1;
+                        continue;
+                }
+                status |= fuzz_run(f);
+                fclose(f);
+        }
+        return status;
+}
+
+#endif // FUZZ_LIBFUZZER
+
+#endif // FUZZ_H_
@@ -0,0 +1,62 @@
+/* fuzz_date.c
+ *
+ * Desc:
+ * Fuzz harness of date.h. Each input is parsed as a date expression
+ * relative to a few times, around changes of summer time and the ends of
+ * the year included. Errors have to come with a message. The input is
+ * copied to a buffer of its exact size, null terminated, so sanitizers
+ * catch reads past it.
+ *
+ * Usage:
+ * make fuzz-date
+ * ./fuzz-date < input          (also as AFL target: afl-fuzz -i in -o out ./fuzz-date)
+ * ./fuzz-date FILE...          (runs a corpus)
+ * make fuzz-date FUZZ_CC=clang FUZZ_FLAGS="-fsanitize=fuzzer,address -DFUZZ_LIBFUZZER"
+ *
+ * Author: Hugo Coto Florez
+ * Repo: https://github.com/hugootoflorez/todo
+ * License: licenseless
+ * Standard: C11
+ * ------------------------------------------------------*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#define DATE_IMPLEMENTATION
+#include "date.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fuzz.h"
+
+int
+LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+        static const time_t nows[] = {
+                0,
+                1760954400, /* Mon 2025-10-20 10:00 UTC */
+                1761440400, /* Sun 2025-10-26 01:00 UTC, summer time ends in Europe */
+                1767225599, /* Wed 2025-12-31 23:59:59 UTC */
+        };
+        char *src = malloc(size + 1);
+        const char *error;
+        time_t t;
+
+        assert(src);
+        memcpy(src, data, size);
+        src[size] = 0;
+
+        for (size_t i = 0; i < sizeof nows / sizeof *nows; i++) {
+                error = NULL;
+                t = date_parse(src, nows[i], &error);
+                /* -1 is also a second before the epoch, with no error */
+                assert(t != -1 || error != NULL || nows[i] < 86400);
+                if (error)
+                        assert(t == -1 && *error);
+        }
+
+        free(src);
+        return 0;
+}
@@ -0,0 +1,81 @@
+/* fuzz_http.c
+ *
+ * Desc:
+ * Fuzz harness of http.h. Each input is parsed as a request head whole
+ * and a byte at a time, that have to agree, and then its query
+ * parameters, headers and path are read and decoded. The input is copied
+ * to a buffer of its exact size, so sanitizers catch reads past it.
+ *
+ * Usage:
+ * make fuzz-http
+ * ./fuzz-http < input          (also as AFL target: afl-fuzz -i in -o out ./fuzz-http)
+ * ./fuzz-http FILE...          (runs a corpus)
+ * make fuzz-http FUZZ_CC=clang FUZZ_FLAGS="-fsanitize=fuzzer,address -DFUZZ_LIBFUZZER"
+ *
+ * Author: Hugo Coto Florez
+ * Repo: https://github.com/hugootoflorez/todo
+ * License: licenseless
+ * Standard: C11
+ * ------------------------------------------------------*/
+
+#define HTTP_IMPLEMENTATION
+#include "http.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fuzz.h"
+
+int
+LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+        static const char *params[] = { "q", "button", "x", "" };
+        static const char *headers[] = { "Host", "Connection", "Content-Length", "Accept-Encoding" };
+        char *buf = malloc(size ? size : 1);
+        char dst[64];
+        Http_Request whole;
+        Http_Request bytewise;
+        const char *value;
+        size_t len;
+        int status;
+        int partial = HTTP_PARTIAL;
+
+        assert(buf);
+        memcpy(buf, data, size);
+
+        http_init(&whole);
+        status = http_parse(&whole, buf, size);
+
+        /* A byte at a time, as if each came in a read */
+        http_init(&bytewise);
+        for (size_t n = 1; n <= size && partial == HTTP_PARTIAL; n++)
+                partial = http_parse(&bytewise, buf, n);
+        assert(partial == status);
+        assert(whole.head_len == bytewise.head_len);
+        assert(whole.content_length == bytewise.content_length);
+
+        if (status == HTTP_DONE) {
+                assert(whole.head_len <= size);
+                assert(whole.path.off + whole.path.len <= whole.head_len);
+                assert(whole.query.off + whole.query.len <= whole.head_len);
+                for (size_t i = 0; i < sizeof params / sizeof *params; i++)
+                        for (size_t cap = 0; cap <= sizeof dst; cap += 7)
+                                if (http_query(&whole, buf, params[i], dst, cap) >= 0)
+                                        assert(strlen(dst) < cap);
+                for (size_t i = 0; i < sizeof headers / sizeof *headers; i++)
+                        if ((value = http_header(&whole, buf, headers[i], &len)))
+                                assert(value + len <= buf + whole.head_len);
+                http_keep_alive(&whole, buf);
+                if (http_decode(dst, sizeof dst, buf + whole.path.off, whole.path.len, false) >= 0)
+                        assert(strlen(dst) < sizeof dst);
+        }
+
+        /* Any bytes, not only the ones of a request */
+        for (size_t cap = 0; cap <= sizeof dst; cap += 13)
+                http_decode(dst, cap, buf, size, true);
+
+        free(buf);
+        return 0;
+}
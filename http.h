@@ -0,0 +1,327 @@
+#ifndef HTTP_H_
+#define HTTP_H_
+
+/* http.h -- incremental HTTP/1.x request parser
+ *
+ * Author: Hugo Coto Florez
+ * Repo: https://github.com/hugootoflorez/todo
+ * License: licenseless
+ *
+ * http_parse() reads the head of a request, the request line and the
+ * headers, from a buffer that can be incomplete. It returns HTTP_PARTIAL
+ * until the empty line after the headers is in the buffer, and each call
+ * only reads the bytes added since the last one, so heads split in many
+ * reads cost the same as heads read at once. Nothing is allocated and the
+ * buffer is not modified: parts of the request are offsets into it, so it
+ * can be moved or grown between calls.
+ *
+ * Lines can end in CRLF or LF. Folded headers and Transfer-Encoding are
+ * rejected, and bodies are only known by their Content-Length.
+ *
+ * Usage:
+ *   Http_Request r;
+ *   http_init(&r);
+ *   while ((status = http_parse(&r, buf, len)) == HTTP_PARTIAL)
+ *           len += read(fd, buf + len, size - len);
+ *   if (status == HTTP_DONE)
+ *           http_query(&r, buf, "q", query, sizeof query);
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define HTTP_MAX_HEADERS 32
+
+enum http_status {
+        HTTP_PARTIAL = 0, /* the head is not complete yet */
+        HTTP_DONE,
+        HTTP_BAD_REQUEST,
+        HTTP_TOO_MANY_HEADERS,
+};
+
+/* LEN bytes at offset OFF of the buffer */
+typedef struct {
+        size_t off;
+        size_t len;
+} Http_Span;
+
+typedef struct {
+        Http_Span name;
+        Http_Span value; /* without surrounding spaces */
+} Http_Header;
+
+typedef struct {
+        Http_Span method;
+        Http_Span target; /* path and query */
+        Http_Span path; /* not decoded */
+        Http_Span query; /* after '?', not decoded */
+        int minor; /* HTTP/1.MINOR */
+        Http_Header headers[HTTP_MAX_HEADERS];
+        int header_count;
+        long long content_length; /* 0 if there is no body */
+        size_t head_len; /* with the empty line, 0 until HTTP_DONE */
+        /* Parser state */
+        size_t line; /* start of the line being read */
+        size_t scanned; /* bytes searched for its end */
+        bool has_length; /* a Content-Length was read */
+} Http_Request;
+
+void http_init(Http_Request *r);
+/* Parse the head of the request in the LEN bytes of BUF, that starts with
+ * the bytes of the previous calls. Returns an enum http_status */
+int http_parse(Http_Request *r, const char *buf, size_t len);
+/* Whether the span S of BUF is STR */
+bool http_span_is(const char *buf, Http_Span s, const char *str);
+/* Value of the header NAME, case insensitive, or NULL. It is not null
+ * terminated, its length is stored in *LEN */
+const char *http_header(const Http_Request *r, const char *buf, const char *name, size_t *len);
+/* Whether the client allows more requests in the connection */
+bool http_keep_alive(const Http_Request *r, const char *buf);
+/* Decode the N bytes of SRC, with %XX escapes and '+' as space if PLUS,
+ * into DST of SIZE bytes, null terminated. Returns the length, or -1 if
+ * an escape is invalid or encodes a null, or DST is too small */
+long http_decode(char *dst, size_t size, const char *src, size_t n, bool plus);
+/* Decode the value of the query parameter NAME into DST, as
+ * http_decode(). Returns its length, or -1 if there is no such parameter
+ * or it can not be decoded */
+long http_query(const Http_Request *r, const char *buf, const char *name, char *dst, size_t size);
+
+#endif // HTTP_H_
+
+#ifdef HTTP_IMPLEMENTATION
+
+#include <string.h>
+#include <strings.h>
+
+void
+http_init(Http_Request *r)
+{
+        memset(r, 0, sizeof *r);
+        r->minor = -1;
+}
+
+/* tchar of RFC 9110 */
+static bool
+http_is_token(char c)
+{
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+               (c >= '0' && c <= '9') || (c && strchr("!#$%&'*+-.^_`|~", c));
+}
+
+static size_t
+http_token(const char *s, size_t n)
+{
+        size_t i = 0;
+        while (i < n && http_is_token(s[i]))
+                ++i;
+        return i;
+}
+
+/* METHOD SP TARGET SP HTTP/1.X */
+static int
+http_request_line(Http_Request *r, const char *buf, size_t off, size_t n)
+{
+        const char *s = buf + off;
+        size_t i;
+        size_t t;
+
+        if ((i = http_token(s, n)) == 0 || i == n || s[i] != ' ')
+                return HTTP_BAD_REQUEST;
+        r->method = (Http_Span) { off, i };
+
+        /* Origin form only, no spaces nor control characters */
+        t = ++i;
+        while (i < n && s[i] != ' ') {
+                if ((unsigned char) s[i] <= 0x20 || s[i] == 0x7f)
+                        return HTTP_BAD_REQUEST;
+                ++i;
+        }
+        if (i == t || s[t] != '/')
+                return HTTP_BAD_REQUEST;
+        r->target = (Http_Span) { off + t, i - t };
+        r->path = r->target;
+        for (size_t q = t; q < i; q++) {
+                if (s[q] == '?') {
+                        r->path.len = q - t;
+                        r->query = (Http_Span) { off + q + 1, i - q - 1 };
+                        break;
+                }
+        }
+
+        if (n - i != 9 || memcmp(s + i, " HTTP/1.", 8) || s[n - 1] < '0' || s[n - 1] > '9')
+                return HTTP_BAD_REQUEST;
+        r->minor = s[n - 1] - '0';
+        return HTTP_PARTIAL;
+}
+
+/* NAME ":" OWS VALUE OWS */
+static int
+http_header_line(Http_Request *r, const char *buf, size_t off, size_t n)
+{
+        const char *s = buf + off;
+        Http_Header *h;
+        long long length;
+        size_t i;
+        size_t v;
+
+        /* Folded lines are obsolete, and would hide headers */
+        if ((i = http_token(s, n)) == 0 || i == n || s[i] != ':')
+                return HTTP_BAD_REQUEST;
+        if (r->header_count == HTTP_MAX_HEADERS)
+                return HTTP_TOO_MANY_HEADERS;
+
+        for (v = i + 1; v < n && (s[v] == ' ' || s[v] == '\t'); v++)
+                ;
+        while (n > v && (s[n - 1] == ' ' || s[n - 1] == '\t'))
+                --n;
+        for (size_t c = v; c < n; c++)
+                if (((unsigned char) s[c] < 0x20 && s[c] != '\t') || s[c] == 0x7f)
+                        return HTTP_BAD_REQUEST;
+
+        h = &r->headers[r->header_count++];
+        h->name = (Http_Span) { off, i };
+        h->value = (Http_Span) { off + v, n - v };
+
+        /* Bodies have to be skipped to find the next request, so their
+         * length can not be ambiguous */
+        if (http_span_is(buf, h->name, "Transfer-Encoding"))
+                return HTTP_BAD_REQUEST;
+        if (http_span_is(buf, h->name, "Content-Length")) {
+                if (v == n || n - v > 15)
+                        return HTTP_BAD_REQUEST;
+                length = 0;
+                for (size_t c = v; c < n; c++) {
+                        if (s[c] < '0' || s[c] > '9')
+                                return HTTP_BAD_REQUEST;
+                        length = length * 10 + (s[c] - '0');
+                }
+                /* Repeated values have to match, 0 included */
+                if (r->has_length && r->content_length != length)
+                        return HTTP_BAD_REQUEST;
+                r->content_length = length;
+                r->has_length = true;
+        }
+        return HTTP_PARTIAL;
+}
+
+int
+http_parse(Http_Request *r, const char *buf, size_t len)
+{
+        const char *nl;
+        size_t end;
+        size_t n;
+        int status;
+
+        while (r->head_len == 0) {
+                if ((nl = memchr(buf + r->scanned, '\n', len - r->scanned)) == NULL) {
+                        r->scanned = len;
+                        return HTTP_PARTIAL;
+                }
+                end = nl - buf;
+                r->scanned = end + 1;
+                n = end - r->line;
+                if (n > 0 && buf[end - 1] == '\r')
+                        --n;
+
+                if (r->minor < 0) {
+                        /* Empty lines before the request are ignored */
+                        status = n ? http_request_line(r, buf, r->line, n) : HTTP_PARTIAL;
+                } else if (n == 0) {
+                        r->head_len = end + 1;
+                        break;
+                } else
+                        status = http_header_line(r, buf, r->line, n);
+
+                if (status != HTTP_PARTIAL)
+                        return status;
+                r->line = end + 1;
+        }
+        return HTTP_DONE;
+}
+
+bool
+http_span_is(const char *buf, Http_Span s, const char *str)
+{
+        return strlen(str) == s.len && strncasecmp(buf + s.off, str, s.len) == 0;
+}
+
+const char *
+http_header(const Http_Request *r, const char *buf, const char *name, size_t *len)
+{
+        for (int i = 0; i < r->header_count; i++) {
+                if (http_span_is(buf, r->headers[i].name, name)) {
+                        *len = r->headers[i].value.len;
+                        return buf + r->headers[i].value.off;
+                }
+        }
+        return NULL;
+}
+
+bool
+http_keep_alive(const Http_Request *r, const char *buf)
+{
+        const char *conn;
+        size_t n = 0;
+
+        conn = http_header(r, buf, "Connection", &n);
+        if (r->minor == 0)
+                return conn && n >= 10 && strncasecmp(conn, "keep-alive", 10) == 0;
+        return !(conn && n >= 5 && strncasecmp(conn, "close", 5) == 0);
+}
+
+static int
+http_hex(char c)
+{
+        if (c >= '0' && c <= '9')
+                return c - '0';
+        if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+                return (c | 0x20) - 'a' + 10;
+        return -1;
+}
+
+long
+http_decode(char *dst, size_t size, const char *src, size_t n, bool plus)
+{
+        size_t i = 0;
+        int hi;
+        int lo;
+
+        for (size_t c = 0; c < n; c++) {
+                if (i + 1 >= size)
+                        return -1;
+                if (src[c] == '%') {
+                        if (n - c < 3 || (hi = http_hex(src[c + 1])) < 0 ||
+                            (lo = http_hex(src[c + 2])) < 0 || (hi | lo) == 0)
+                                return -1;
+                        dst[i++] = hi << 4 | lo;
+                        c += 2;
+                } else
+                        dst[i++] = plus && src[c] == '+' ? ' ' : src[c];
+        }
+        if (size == 0)
+                return -1;
+        dst[i] = 0;
+        return i;
+}
+
+long
+http_query(const Http_Request *r, const char *buf, const char *name, char *dst, size_t size)
+{
+        const char *p = buf + r->query.off;
+        const char *end = p + r->query.len;
+        const char *amp;
+        const char *eq;
+        size_t n = strlen(name);
+
+        for (; p < end; p = amp + 1) {
+                if ((amp = memchr(p, '&', end - p)) == NULL)
+                        amp = end;
+                if ((eq = memchr(p, '=', amp - p)) == NULL)
+                        eq = amp;
+                if ((size_t) (eq - p) == n && memcmp(p, name, n) == 0)
+                        return http_decode(dst, size, eq + (eq < amp), amp - eq - (eq < amp), true);
+        }
+        return -1;
+}
+
+#endif // HTTP_IMPLEMENTATION
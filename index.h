@@ -0,0 +1,459 @@
+#ifndef INDEX_H_
+#define INDEX_H_
+
+/* index.h -- in memory inverted index
+ *
+ * Author: Hugo Coto Florez
+ * Repo: https://github.com/hugootoflorez/todo
+ * License: licenseless
+ *
+ * Maps tokens (lowercase runs of letters and digits) to sorted posting
+ * lists of ids. Tokens live in a hash table for exact lookups and in a
+ * sorted array, so all the tokens with a given prefix are a contiguous
+ * range found with a binary search. New tokens are appended to the array
+ * and it is sorted again only when needed, so building an index is not
+ * quadratic on the number of tokens. Posting lists work the same way when
+ * ids are not added in order. Substring lookups scan the token
+ * dictionary, that is much smaller than the indexed texts.
+ *
+ * Usage:
+ *   Index ix = { 0 };
+ *   index_add(&ix, 3, "Buy milk");
+ *   index_query(&ix, "mil", &ids, &n);   // prefix: ids = { 3 }
+ *   index_query(&ix, "*il", &ids, &n);   // substring
+ *   index_remove(&ix, 3, "Buy milk");
+ *   index_destroy(&ix);
+ *
+ * Keys are indexed as they are, without splitting them in tokens:
+ *   index_add_key(&ix, 3, "Home-Office");
+ *   index_key(&ix, "Home-Office", &ids); // returns 1, ids = { 3 }
+ */
+
+#include <stddef.h>
+
+#define INDEX_TOKEN_MAX 64
+
+typedef struct {
+        char *token;
+        int *ids; /* sorted and unique, if not dirty */
+        int size;
+        int capacity;
+        int dirty;
+} Index_Token;
+
+typedef struct {
+        Index_Token **table; /* open addressing */
+        int table_cap;
+        int table_used; /* including tombstones */
+        Index_Token **sorted; /* by token, if not dirty */
+        int size;
+        int capacity;
+        int dirty; /* new tokens are appended and sorted when needed */
+} Index;
+
+/* Index every token of TEXT under ID. TEXT can be NULL */
+void index_add(Index *ix, int id, const char *text);
+/* Remove ID from every token of TEXT. TEXT has to be the indexed text */
+void index_remove(Index *ix, int id, const char *text);
+/* Get the sorted ids that match every word in QUERY. A word matches the
+ * tokens it is prefix of, or the tokens that contain it if the word starts
+ * with '*'. *IDS is malloced and has to be freed. Returns *N. */
+int index_query(Index *ix, const char *query, int **ids, int *n);
+/* Index ID under the whole KEY, that is not split in tokens */
+void index_add_key(Index *ix, int id, const char *key);
+/* Remove ID from KEY */
+void index_remove_key(Index *ix, int id, const char *key);
+/* Get the sorted ids indexed under KEY. *IDS points into the index and is
+ * valid until it changes. Returns the number of ids. */
+int index_key(Index *ix, const char *key, const int **ids);
+void index_destroy(Index *ix);
+
+#endif // INDEX_H_
+
+#ifdef INDEX_IMPLEMENTATION
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INDEX_TOMBSTONE ((Index_Token *) -1)
+
+/* Get the next token of *TEXT into TOKEN and advance *TEXT. Returns the
+ * token length or 0 if there are no more tokens. Long tokens are cut. */
+static int
+index_next_token(const char **text, char token[INDEX_TOKEN_MAX])
+{
+        const unsigned char *c = (const unsigned char *) *text;
+        int n = 0;
+
+        while (*c && !isalnum(*c) && *c != '*')
+                ++c;
+        if (*c == '*')
+                token[n++] = *c++;
+        while (*c && isalnum(*c)) {
+                if (n < INDEX_TOKEN_MAX - 1)
+                        token[n++] = tolower(*c);
+                ++c;
+        }
+        token[n] = 0;
+        *text = (const char *) c;
+        return n;
+}
+
+static uint64_t
+index_hash(const char *s)
+{
+        uint64_t h = 14695981039346656037ull;
+        while (*s)
+                h = (h ^ (unsigned char) *s++) * 1099511628211ull;
+        return h;
+}
+
+/* Get the hash table slot of TOKEN, or the slot where it should go */
+static int
+index_slot(Index *ix, const char *token)
+{
+        int mask = ix->table_cap - 1;
+        int i = index_hash(token) & mask;
+        int free_slot = -1;
+
+        for (; ix->table[i]; i = (i + 1) & mask) {
+                if (ix->table[i] == INDEX_TOMBSTONE) {
+                        if (free_slot < 0)
+                                free_slot = i;
+                } else if (strcmp(ix->table[i]->token, token) == 0)
+                        return i;
+        }
+        return free_slot >= 0 ? free_slot : i;
+}
+
+static void
+index_rehash(Index *ix)
+{
+        Index_Token **old = ix->table;
+        int old_cap = ix->table_cap;
+
+        ix->table_cap = old_cap ? old_cap * 2 : 256;
+        /* Only tombstones, do not grow */
+        if (ix->size * 2 < old_cap)
+                ix->table_cap = old_cap;
+        ix->table = calloc(ix->table_cap, sizeof *ix->table);
+        assert(ix->table);
+        ix->table_used = 0;
+        for (int i = 0; i < old_cap; i++) {
+                if (old[i] && old[i] != INDEX_TOMBSTONE) {
+                        ix->table[index_slot(ix, old[i]->token)] = old[i];
+                        ++ix->table_used;
+                }
+        }
+        free(old);
+}
+
+static int
+index_cmp_token(const void *a, const void *b)
+{
+        return strcmp((*(Index_Token **) a)->token, (*(Index_Token **) b)->token);
+}
+
+/* First position in the sorted array whose token is >= TOKEN */
+static int
+index_lower_bound(Index *ix, const char *token)
+{
+        int lo = 0;
+        int hi = ix->size;
+        int mid;
+
+        if (ix->dirty) {
+                qsort(ix->sorted, ix->size, sizeof *ix->sorted, index_cmp_token);
+                ix->dirty = 0;
+        }
+
+        while (lo < hi) {
+                mid = (lo + hi) / 2;
+                if (strcmp(ix->sorted[mid]->token, token) < 0)
+                        lo = mid + 1;
+                else
+                        hi = mid;
+        }
+        return lo;
+}
+
+static Index_Token *
+index_get(Index *ix, const char *token, int create)
+{
+        Index_Token *t;
+        int slot;
+
+        if (ix->table_cap == 0 || (ix->table_used + 1) * 4 > ix->table_cap * 3)
+                index_rehash(ix);
+
+        slot = index_slot(ix, token);
+        if (ix->table[slot] && ix->table[slot] != INDEX_TOMBSTONE)
+                return ix->table[slot];
+        if (!create)
+                return NULL;
+
+        t = calloc(1, sizeof *t);
+        assert(t);
+        t->token = strdup(token);
+        assert(t->token);
+        if (ix->table[slot] == NULL)
+                ++ix->table_used;
+        ix->table[slot] = t;
+
+        if (ix->size == ix->capacity) {
+                ix->capacity = ix->capacity ? ix->capacity * 2 : 256;
+                ix->sorted = realloc(ix->sorted, ix->capacity * sizeof *ix->sorted);
+                assert(ix->sorted);
+        }
+        ix->sorted[ix->size++] = t;
+        ix->dirty = 1;
+        return t;
+}
+
+static void
+index_drop(Index *ix, Index_Token *t)
+{
+        int pos = index_lower_bound(ix, t->token);
+        ix->table[index_slot(ix, t->token)] = INDEX_TOMBSTONE;
+        memmove(ix->sorted + pos, ix->sorted + pos + 1, (ix->size - pos - 1) * sizeof *ix->sorted);
+        --ix->size;
+        free(t->token);
+        free(t->ids);
+        free(t);
+}
+
+static int
+index_cmp_int(const void *a, const void *b)
+{
+        return (*(int *) a > *(int *) b) - (*(int *) a < *(int *) b);
+}
+
+/* Sort and remove duplicates of an array of N ids. Returns the new size */
+static int
+index_sort_ids(int *ids, int n)
+{
+        int k = 0;
+        qsort(ids, n, sizeof *ids, index_cmp_int);
+        for (int i = 0; i < n; i++)
+                if (k == 0 || ids[k - 1] != ids[i])
+                        ids[k++] = ids[i];
+        return k;
+}
+
+static void
+index_token_sort(Index_Token *t)
+{
+        if (t->dirty) {
+                t->size = index_sort_ids(t->ids, t->size);
+                t->dirty = 0;
+        }
+}
+
+/* Position of ID in the posting list of T, or where it should be */
+static int
+index_id_pos(Index_Token *t, int id)
+{
+        int lo = 0;
+        int hi = t->size;
+        int mid;
+
+        index_token_sort(t);
+
+        /* Ids usually grow, check the end first */
+        if (t->size == 0 || t->ids[t->size - 1] < id)
+                return t->size;
+        while (lo < hi) {
+                mid = (lo + hi) / 2;
+                if (t->ids[mid] < id)
+                        lo = mid + 1;
+                else
+                        hi = mid;
+        }
+        return lo;
+}
+
+/* Append ID to the posting list of T */
+static void
+index_token_add(Index_Token *t, int id)
+{
+        if (t->size && t->ids[t->size - 1] == id)
+                return;
+        if (t->size == t->capacity) {
+                t->capacity = t->capacity ? t->capacity * 2 : 4;
+                t->ids = realloc(t->ids, t->capacity * sizeof *t->ids);
+                assert(t->ids);
+        }
+        if (t->size && t->ids[t->size - 1] > id)
+                t->dirty = 1;
+        t->ids[t->size++] = id;
+}
+
+/* Remove ID from the posting list of T, and T from IX if it is empty */
+static void
+index_token_remove(Index *ix, Index_Token *t, int id)
+{
+        int pos = index_id_pos(t, id);
+        if (pos == t->size || t->ids[pos] != id)
+                return;
+        memmove(t->ids + pos, t->ids + pos + 1, (t->size - pos - 1) * sizeof *t->ids);
+        if (--t->size == 0)
+                index_drop(ix, t);
+}
+
+void
+index_add(Index *ix, int id, const char *text)
+{
+        char token[INDEX_TOKEN_MAX];
+
+        while (text && index_next_token(&text, token)) {
+                if (*token == '*')
+                        continue;
+                index_token_add(index_get(ix, token, 1), id);
+        }
+}
+
+void
+index_remove(Index *ix, int id, const char *text)
+{
+        char token[INDEX_TOKEN_MAX];
+        Index_Token *t;
+
+        while (text && ix->size && index_next_token(&text, token)) {
+                if (*token == '*' || (t = index_get(ix, token, 0)) == NULL)
+                        continue;
+                index_token_remove(ix, t, id);
+        }
+}
+
+void
+index_add_key(Index *ix, int id, const char *key)
+{
+        index_token_add(index_get(ix, key, 1), id);
+}
+
+void
+index_remove_key(Index *ix, int id, const char *key)
+{
+        Index_Token *t;
+        if (ix->size && (t = index_get(ix, key, 0)))
+                index_token_remove(ix, t, id);
+}
+
+int
+index_key(Index *ix, const char *key, const int **ids)
+{
+        Index_Token *t = ix->size ? index_get(ix, key, 0) : NULL;
+
+        *ids = NULL;
+        if (t == NULL)
+                return 0;
+        index_token_sort(t);
+        *ids = t->ids;
+        return t->size;
+}
+
+/* Union of the posting lists of every token matching WORD. Returns the
+ * number of ids stored in *OUT (sorted, without duplicates) */
+static int
+index_match_word(Index *ix, const char *word, int **out)
+{
+        int total = 0;
+        int n = 0;
+        int lo, hi;
+        size_t len;
+        int substr;
+
+        substr = *word == '*';
+        word += substr;
+        len = strlen(word);
+
+        if (substr) {
+                /* Order does not matter */
+                lo = 0;
+                hi = ix->size;
+        } else {
+                lo = index_lower_bound(ix, word);
+                for (hi = lo; hi < ix->size && strncmp(ix->sorted[hi]->token, word, len) == 0; hi++)
+                        ;
+        }
+
+        for (int i = lo; i < hi; i++) {
+                if (!substr || strstr(ix->sorted[i]->token, word)) {
+                        index_token_sort(ix->sorted[i]);
+                        total += ix->sorted[i]->size;
+                }
+        }
+
+        *out = malloc((total ? total : 1) * sizeof **out);
+        assert(*out);
+        for (int i = lo; i < hi; i++) {
+                if (substr && !strstr(ix->sorted[i]->token, word))
+                        continue;
+                memcpy(*out + n, ix->sorted[i]->ids, ix->sorted[i]->size * sizeof **out);
+                n += ix->sorted[i]->size;
+        }
+
+        /* A single posting list is already sorted and unique */
+        if (hi - lo > 1 || substr)
+                n = index_sort_ids(*out, n);
+        return n;
+}
+
+int
+index_query(Index *ix, const char *query, int **ids, int *n)
+{
+        char word[INDEX_TOKEN_MAX];
+        int *match;
+        int m;
+        int k;
+        int first = 1;
+
+        *ids = NULL;
+        *n = 0;
+
+        while (index_next_token(&query, word)) {
+                if (strcmp(word, "*") == 0)
+                        continue;
+                m = index_match_word(ix, word, &match);
+                if (first) {
+                        *ids = match;
+                        *n = m;
+                        first = 0;
+                        continue;
+                }
+                /* Intersect sorted lists */
+                k = 0;
+                for (int i = 0, j = 0; i < *n && j < m;) {
+                        if ((*ids)[i] < match[j])
+                                ++i;
+                        else if ((*ids)[i] > match[j])
+                                ++j;
+                        else {
+                                (*ids)[k++] = (*ids)[i];
+                                ++i;
+                                ++j;
+                        }
+                }
+                *n = k;
+                free(match);
+        }
+        return *n;
+}
+
+void
+index_destroy(Index *ix)
+{
+        for (int i = 0; i < ix->size; i++) {
+                free(ix->sorted[i]->token);
+                free(ix->sorted[i]->ids);
+                free(ix->sorted[i]);
+        }
+        free(ix->sorted);
+        free(ix->table);
+        memset(ix, 0, sizeof *ix);
+}
+
+#endif // INDEX_IMPLEMENTATION
@@ -0,0 +1,346 @@
+#ifndef LOG_H_
+#define LOG_H_
+
+/* log.h -- runtime levelled, non blocking logger
+ *
+ * Author: Hugo Coto Florez
+ * Repo: https://github.com/hugootoflorez/todo
+ * License: licenseless
+ *
+ * Until log_start() is called every message is written synchronously to
+ * stderr, that is what a short lived command wants. After log_start(),
+ * each thread writes its records into its own single producer ring and a
+ * background thread formats and writes them in batches, so logging only
+ * costs a vsnprintf and a couple of atomics to the caller. Rings are
+ * recycled when their thread exits. If a ring is full the record is
+ * dropped and counted instead of blocking.
+ *
+ * Records are written one per line as:
+ *   2026-01-01T10:00:00.000000Z level=info tid=3 msg="..."
+ *
+ * Usage:
+ *   log_set_level(LOG_LEVEL_INFO);
+ *   log_start(fd);
+ *   LOGI("listening on port %d", port);
+ *   log_stop();
+ */
+
+#include <stdarg.h>
+#include <stdint.h>
+
+enum log_level {
+        LOG_LEVEL_NONE = 0,
+        LOG_LEVEL_ERROR,
+        LOG_LEVEL_WARN,
+        LOG_LEVEL_INFO,
+        LOG_LEVEL_DEBUG,
+};
+
+#ifndef LOG_RINGS
+#define LOG_RINGS 64
+#endif
+#define LOG_RING_SLOTS 128
+#define LOG_MSG_MAX 240
+
+extern int log_level;
+
+#define LOGE(...) (log_level >= LOG_LEVEL_ERROR ? log_msg(LOG_LEVEL_ERROR, __VA_ARGS__) : (void) 0)
+#define LOGW(...) (log_level >= LOG_LEVEL_WARN ? log_msg(LOG_LEVEL_WARN, __VA_ARGS__) : (void) 0)
+#define LOGI(...) (log_level >= LOG_LEVEL_INFO ? log_msg(LOG_LEVEL_INFO, __VA_ARGS__) : (void) 0)
+#define LOGD(...) (log_level >= LOG_LEVEL_DEBUG ? log_msg(LOG_LEVEL_DEBUG, __VA_ARGS__) : (void) 0)
+
+void log_msg(enum log_level level, const char *format, ...);
+/* Parse "none", "error", "warn", "info" or "debug". Returns -1 if invalid */
+int log_level_from_str(const char *str);
+void log_set_level(int level);
+/* Start the background writer. Records are written to FD */
+void log_start(int fd);
+/* Write all pending records. Can be called from any thread */
+void log_flush(void);
+/* Flush and stop the background writer */
+void log_stop(void);
+/* Records dropped because a ring was full or no ring was free */
+uint64_t log_dropped(void);
+
+#endif // LOG_H_
+
+#ifdef LOG_IMPLEMENTATION
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+        struct timespec ts;
+        int level;
+        int tid;
+        char msg[LOG_MSG_MAX];
+} Log_Record;
+
+typedef struct {
+        _Alignas(64) int owned;
+        _Alignas(64) uint64_t head; /* Only written by the owner thread */
+        _Alignas(64) uint64_t tail; /* Only written by the consumer */
+        Log_Record slots[LOG_RING_SLOTS];
+} Log_Ring;
+
+int log_level = LOG_LEVEL_ERROR;
+
+static const char *log_level_names[] = {
+        [LOG_LEVEL_NONE] = "none",
+        [LOG_LEVEL_ERROR] = "error",
+        [LOG_LEVEL_WARN] = "warn",
+        [LOG_LEVEL_INFO] = "info",
+        [LOG_LEVEL_DEBUG] = "debug",
+};
+
+static struct {
+        Log_Ring *rings[LOG_RINGS];
+        int async;
+        int running;
+        int fd;
+        uint64_t dropped;
+        int next_tid;
+        pthread_t writer;
+        /* Only taken by consumers (writer thread and log_flush) */
+        pthread_mutex_t drain_lock;
+        pthread_once_t key_once;
+        pthread_key_t key;
+} log_ctx = {
+        .fd = 2,
+        .drain_lock = PTHREAD_MUTEX_INITIALIZER,
+        .key_once = PTHREAD_ONCE_INIT,
+};
+
+static _Thread_local Log_Ring *log_ring = NULL;
+static _Thread_local int log_tid = 0;
+
+int
+log_level_from_str(const char *str)
+{
+        for (int i = 0; i < (int) (sizeof log_level_names / sizeof *log_level_names); i++)
+                if (strcasecmp(str, log_level_names[i]) == 0)
+                        return i;
+        return -1;
+}
+
+void
+log_set_level(int level)
+{
+        log_level = level;
+}
+
+uint64_t
+log_dropped(void)
+{
+        return __atomic_load_n(&log_ctx.dropped, __ATOMIC_RELAXED);
+}
+
+static void
+log_ring_release(void *ring)
+{
+        __atomic_store_n(&((Log_Ring *) ring)->owned, 0, __ATOMIC_RELEASE);
+}
+
+static void
+log_key_create(void)
+{
+        pthread_key_create(&log_ctx.key, log_ring_release);
+}
+
+static Log_Ring *
+log_ring_acquire(void)
+{
+        Log_Ring *ring;
+        int expected;
+
+        pthread_once(&log_ctx.key_once, log_key_create);
+
+        for (int i = 0; i < LOG_RINGS; i++) {
+                ring = __atomic_load_n(&log_ctx.rings[i], __ATOMIC_ACQUIRE);
+                if (ring == NULL) {
+                        /* Reserve slot I by publishing a new ring there */
+                        ring = calloc(1, sizeof *ring);
+                        if (ring == NULL)
+                                return NULL;
+                        ring->owned = 1;
+                        Log_Ring *null = NULL;
+                        if (__atomic_compare_exchange_n(&log_ctx.rings[i], &null, ring, 0,
+                                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+                                goto found;
+                        free(ring);
+                        ring = null;
+                }
+                expected = 0;
+                if (__atomic_compare_exchange_n(&ring->owned, &expected, 1, 0,
+                                                __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+                        goto found;
+        }
+        return NULL;
+
+found:
+        pthread_setspecific(log_ctx.key, ring);
+        return ring;
+}
+
+static size_t
+log_format(char *out, size_t size, Log_Record *r)
+{
+        struct tm tm;
+        size_t n;
+        size_t len;
+
+        gmtime_r(&r->ts.tv_sec, &tm);
+        n = strftime(out, size, "%Y-%m-%dT%H:%M:%S", &tm);
+        n += snprintf(out + n, size - n, ".%06ldZ level=%s tid=%d msg=\"",
+                      r->ts.tv_nsec / 1000, log_level_names[r->level], r->tid);
+
+        len = strlen(r->msg);
+        while (len > 0 && r->msg[len - 1] == '\n')
+                --len;
+        for (size_t i = 0; i < len && n + 4 < size; i++) {
+                switch (r->msg[i]) {
+                case '"':
+                case '\\':
+                        out[n++] = '\\';
+                        out[n++] = r->msg[i];
+                        break;
+                case '\n':
+                        out[n++] = '\\';
+                        out[n++] = 'n';
+                        break;
+                default:
+                        out[n++] = r->msg[i];
+                        break;
+                }
+        }
+        out[n++] = '"';
+        out[n++] = '\n';
+        return n;
+}
+
+void
+log_msg(enum log_level level, const char *format, ...)
+{
+        Log_Record sync_record;
+        Log_Record *r;
+        va_list arg;
+        uint64_t head;
+        char line[2 * LOG_MSG_MAX + 128];
+
+        if (log_tid == 0)
+                log_tid = __atomic_add_fetch(&log_ctx.next_tid, 1, __ATOMIC_RELAXED);
+
+        if (!__atomic_load_n(&log_ctx.async, __ATOMIC_ACQUIRE)) {
+                r = &sync_record;
+        } else {
+                if (log_ring == NULL && (log_ring = log_ring_acquire()) == NULL) {
+                        __atomic_fetch_add(&log_ctx.dropped, 1, __ATOMIC_RELAXED);
+                        return;
+                }
+                head = log_ring->head;
+                if (head - __atomic_load_n(&log_ring->tail, __ATOMIC_ACQUIRE) >= LOG_RING_SLOTS) {
+                        __atomic_fetch_add(&log_ctx.dropped, 1, __ATOMIC_RELAXED);
+                        return;
+                }
+                r = &log_ring->slots[head % LOG_RING_SLOTS];
+        }
+
+        clock_gettime(CLOCK_REALTIME, &r->ts);
+        r->level = level;
+        r->tid = log_tid;
+        va_start(arg, format);
+        vsnprintf(r->msg, sizeof r->msg, format, arg);
+        va_end(arg);
+
+        if (r == &sync_record) {
+                fwrite(line, 1, log_format(line, sizeof line, r), stderr);
+                return;
+        }
+        __atomic_store_n(&log_ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/* Drain every ring. Returns the number of records written */
+static int
+log_drain(void)
+{
+        static char out[1 << 16];
+        static const size_t max_line = 2 * LOG_MSG_MAX + 128;
+        Log_Ring *ring;
+        uint64_t head;
+        uint64_t tail;
+        size_t n = 0;
+        int count = 0;
+
+        pthread_mutex_lock(&log_ctx.drain_lock);
+        for (int i = 0; i < LOG_RINGS; i++) {
+                ring = __atomic_load_n(&log_ctx.rings[i], __ATOMIC_ACQUIRE);
+                if (ring == NULL)
+                        continue;
+                head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+                for (tail = ring->tail; tail < head; tail++, count++) {
+                        if (n + max_line > sizeof out) {
+                                (void) !write(log_ctx.fd, out, n);
+                                n = 0;
+                        }
+                        n += log_format(out + n, max_line, &ring->slots[tail % LOG_RING_SLOTS]);
+                }
+                __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+        }
+        if (n)
+                (void) !write(log_ctx.fd, out, n);
+        pthread_mutex_unlock(&log_ctx.drain_lock);
+        return count;
+}
+
+static void *
+log_writer(void *arg)
+{
+        (void) arg;
+        struct timespec idle = { .tv_sec = 0, .tv_nsec = 10 * 1000 * 1000 };
+        while (__atomic_load_n(&log_ctx.running, __ATOMIC_ACQUIRE)) {
+                if (log_drain() == 0)
+                        nanosleep(&idle, NULL);
+        }
+        return NULL;
+}
+
+void
+log_start(int fd)
+{
+        if (log_ctx.running)
+                return;
+        log_ctx.fd = fd;
+        log_ctx.running = 1;
+        if (pthread_create(&log_ctx.writer, NULL, log_writer, NULL) != 0) {
+                log_ctx.running = 0;
+                return;
+        }
+        __atomic_store_n(&log_ctx.async, 1, __ATOMIC_RELEASE);
+}
+
+void
+log_flush(void)
+{
+        if (__atomic_load_n(&log_ctx.async, __ATOMIC_ACQUIRE))
+                log_drain();
+        else
+                fflush(stderr);
+}
+
+void
+log_stop(void)
+{
+        if (!log_ctx.running)
+                return;
+        __atomic_store_n(&log_ctx.running, 0, __ATOMIC_RELEASE);
+        pthread_join(log_ctx.writer, NULL);
+        log_drain();
+        __atomic_store_n(&log_ctx.async, 0, __ATOMIC_RELEASE);
+}
+
+#endif // LOG_IMPLEMENTATION
@@ -0,0 +1,246 @@
+#ifndef METRICS_H_
+#define METRICS_H_
+
+/* metrics.h -- lock free counters and latency histograms
+ *
+ * Author: Hugo Coto Florez
+ * Repo: https://github.com/hugootoflorez/todo
+ * License: licenseless
+ *
+ * Every metric is split in METRICS_SHARDS cache aligned shards and each
+ * thread always writes to the same shard with relaxed atomics, so hot paths
+ * never share a cache line nor take a lock. Readers sum all the shards.
+ *
+ * Histograms are HDR-like: values (nanoseconds) are stored in log-linear
+ * buckets, 2^HIST_SUB_BITS buckets per power of two, so the relative error
+ * is bounded (12.5%) from nanoseconds to minutes with a fixed size table.
+ *
+ * Usage:
+ *   Counter requests = COUNTER("todo_requests_total", "Requests", NULL);
+ *   Histogram lat = HISTOGRAM("todo_latency_seconds", "Latency", "phase=\"x\"");
+ *   counter_add(&requests, 1);
+ *   hist_record(&lat, metrics_now_ns() - start);
+ *   counter_print(stream, &requests, 1);
+ *   hist_print(stream, &lat, 1);
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifndef METRICS_SHARDS
+#define METRICS_SHARDS 16
+#endif
+
+#define HIST_SUB_BITS 3
+#define HIST_SUB (1 << HIST_SUB_BITS)
+/* Enough for values up to 2^42 ns (more than one hour) */
+#define HIST_BUCKETS ((42 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+typedef struct {
+        _Alignas(64) uint64_t value;
+} Counter_Shard;
+
+typedef struct {
+        const char *name;
+        const char *help;
+        const char *labels;
+        Counter_Shard shards[METRICS_SHARDS];
+} Counter;
+
+typedef struct {
+        _Alignas(64) uint64_t count;
+        uint64_t sum;
+        uint64_t buckets[HIST_BUCKETS];
+} Hist_Shard;
+
+typedef struct {
+        const char *name;
+        const char *help;
+        const char *labels;
+        Hist_Shard shards[METRICS_SHARDS];
+} Histogram;
+
+#define COUNTER(_name, _help, _labels) \
+        { .name = (_name), .help = (_help), .labels = (_labels) }
+#define HISTOGRAM(_name, _help, _labels) \
+        { .name = (_name), .help = (_help), .labels = (_labels) }
+
+uint64_t metrics_now_ns(void);
+void counter_add(Counter *c, uint64_t n);
+uint64_t counter_get(Counter *c);
+void hist_record(Histogram *h, uint64_t ns);
+/* Merge all the shards of H into OUT */
+void hist_merge(Histogram *h, Hist_Shard *out);
+/* Value (ns) under which there are a Q fraction of the recorded values */
+uint64_t hist_quantile(Hist_Shard *merged, double q);
+/* Prometheus text format. HEADER prints # HELP and # TYPE lines, so
+ * metrics with the same name and different labels only print it once */
+void counter_print(FILE *stream, Counter *c, int header);
+void hist_print(FILE *stream, Histogram *h, int header);
+void gauge_print(FILE *stream, const char *name, const char *help, double value);
+
+#endif // METRICS_H_
+
+#ifdef METRICS_IMPLEMENTATION
+
+#include <string.h>
+#include <time.h>
+
+static int metrics_next_shard = 0;
+static _Thread_local int metrics_shard = -1;
+
+static inline int
+metrics_get_shard(void)
+{
+        if (metrics_shard < 0)
+                metrics_shard = __atomic_fetch_add(&metrics_next_shard, 1, __ATOMIC_RELAXED) % METRICS_SHARDS;
+        return metrics_shard;
+}
+
+uint64_t
+metrics_now_ns(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void
+counter_add(Counter *c, uint64_t n)
+{
+        __atomic_fetch_add(&c->shards[metrics_get_shard()].value, n, __ATOMIC_RELAXED);
+}
+
+uint64_t
+counter_get(Counter *c)
+{
+        uint64_t total = 0;
+        for (int i = 0; i < METRICS_SHARDS; i++)
+                total += __atomic_load_n(&c->shards[i].value, __ATOMIC_RELAXED);
+        return total;
+}
+
+static inline int
+hist_bucket(uint64_t v)
+{
+        int e;
+        int i;
+        if (v < HIST_SUB)
+                return v;
+        e = 63 - __builtin_clzll(v);
+        i = (e - HIST_SUB_BITS + 1) * HIST_SUB + ((v >> (e - HIST_SUB_BITS)) & (HIST_SUB - 1));
+        return i < HIST_BUCKETS ? i : HIST_BUCKETS - 1;
+}
+
+/* Exclusive upper bound of bucket I */
+static inline uint64_t
+hist_bucket_upper(int i)
+{
+        int e;
+        if (i < HIST_SUB)
+                return i + 1;
+        e = i / HIST_SUB + HIST_SUB_BITS - 1;
+        return (uint64_t) (HIST_SUB + i % HIST_SUB + 1) << (e - HIST_SUB_BITS);
+}
+
+void
+hist_record(Histogram *h, uint64_t ns)
+{
+        Hist_Shard *s = &h->shards[metrics_get_shard()];
+        __atomic_fetch_add(&s->buckets[hist_bucket(ns)], 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&s->sum, ns, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&s->count, 1, __ATOMIC_RELAXED);
+}
+
+void
+hist_merge(Histogram *h, Hist_Shard *out)
+{
+        memset(out, 0, sizeof *out);
+        for (int i = 0; i < METRICS_SHARDS; i++) {
+                Hist_Shard *s = &h->shards[i];
+                out->count += __atomic_load_n(&s->count, __ATOMIC_RELAXED);
+                out->sum += __atomic_load_n(&s->sum, __ATOMIC_RELAXED);
+                for (int j = 0; j < HIST_BUCKETS; j++)
+                        out->buckets[j] += __atomic_load_n(&s->buckets[j], __ATOMIC_RELAXED);
+        }
+}
+
+uint64_t
+hist_quantile(Hist_Shard *merged, double q)
+{
+        uint64_t total = 0;
+        uint64_t seen = 0;
+        uint64_t rank;
+
+        for (int j = 0; j < HIST_BUCKETS; j++)
+                total += merged->buckets[j];
+        if (total == 0)
+                return 0;
+
+        rank = (uint64_t) (q * total);
+        if (rank >= total)
+                rank = total - 1;
+
+        for (int j = 0; j < HIST_BUCKETS; j++) {
+                seen += merged->buckets[j];
+                if (seen > rank)
+                        return hist_bucket_upper(j);
+        }
+        return hist_bucket_upper(HIST_BUCKETS - 1);
+}
+
+void
+counter_print(FILE *stream, Counter *c, int header)
+{
+        if (header) {
+                fprintf(stream, "# HELP %s %s\n", c->name, c->help);
+                fprintf(stream, "# TYPE %s counter\n", c->name);
+        }
+        fprintf(stream, "%s%s%s%s %llu\n", c->name,
+                c->labels ? "{" : "", c->labels ? c->labels : "", c->labels ? "}" : "",
+                (unsigned long long) counter_get(c));
+}
+
+/* Only non empty buckets are printed, as printing all of them for every
+ * histogram is too verbose. Cumulative counts are still valid. */
+void
+hist_print(FILE *stream, Histogram *h, int header)
+{
+        Hist_Shard m;
+        uint64_t cumulative = 0;
+
+        hist_merge(h, &m);
+
+        if (header) {
+                fprintf(stream, "# HELP %s %s\n", h->name, h->help);
+                fprintf(stream, "# TYPE %s histogram\n", h->name);
+        }
+
+        for (int j = 0; j < HIST_BUCKETS; j++) {
+                if (m.buckets[j] == 0)
+                        continue;
+                cumulative += m.buckets[j];
+                fprintf(stream, "%s_bucket{%s%sle=\"%.9g\"} %llu\n", h->name,
+                        h->labels ? h->labels : "", h->labels ? "," : "",
+                        hist_bucket_upper(j) / 1e9, (unsigned long long) cumulative);
+        }
+        fprintf(stream, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", h->name,
+                h->labels ? h->labels : "", h->labels ? "," : "",
+                (unsigned long long) cumulative);
+        fprintf(stream, "%s_sum%s%s%s %.9f\n", h->name,
+                h->labels ? "{" : "", h->labels ? h->labels : "", h->labels ? "}" : "",
+                m.sum / 1e9);
+        fprintf(stream, "%s_count%s%s%s %llu\n", h->name,
+                h->labels ? "{" : "", h->labels ? h->labels : "", h->labels ? "}" : "",
+                (unsigned long long) cumulative);
+}
+
+void
+gauge_print(FILE *stream, const char *name, const char *help, double value)
+{
+        fprintf(stream, "# HELP %s %s\n", name, help);
+        fprintf(stream, "# TYPE %s gauge\n", name);
+        fprintf(stream, "%s %.17g\n", name, value);
+}
+
+#endif // METRICS_IMPLEMENTATION
@@ -1,22 +1,50 @@
 #define HIDEN "."
 
-#define BACKUP_PATH "/home/hugo/"
+/* Relative paths are relative to $HOME, see home_path() */
 #define TMP_PATH "/tmp/"
-#define CSS_PATH "dotfiles/todo/"
+#define ASSETS_PATH "dotfiles/todo"
 
-#define IN_FILENAME BACKUP_PATH "todo.out"
-#define OUT_FILENAME BACKUP_PATH "todo.out"
-#define CSS_FILENAME BACKUP_PATH CSS_PATH "styles.css"
-#define LOG_FILENAME BACKUP_PATH HIDEN "log.txt"
+#define IN_FILENAME "todo.out"
+#define OUT_FILENAME "todo.out"
+#define CSS_FILENAME "styles.css" /* in ASSETS_PATH */
+#define LOG_FILENAME HIDEN "log.txt"
 #define PID_FILENAME TMP_PATH "todo-daemon-pid"
+#define SOCKET_FILENAME TMP_PATH "todo-daemon.sock"
+#define ARCHIVE_PATH HIDEN "todo-archive"
+#define LISTS_PATH HIDEN "todo-lists"
 
+/* Settings (paths, ports, sizes, timeouts, formats, logging) can also be
+ * set in the config file, as "port = 5003", or in an environment
+ * variable, as TODO_PORT=5003. Flags override variables, and variables
+ * override the file. Actions, as -add or -serve, are only flags. */
+#define CONFIG_FILENAME HIDEN "config/todo/config"
+#define ENV_PREFIX "TODO_"
+
+/* Defaults of the flags of the same name in lowercase */
 #define PORT 5002
-#define MAX_ATTEMPTS 10
-#define MAX_CLIENTS 16
-#define BUFSIZE 1024 * 1024 /* IO buffer */
+#define MAX_ATTEMPTS 10 /* next ports tried if PORT is in use */
+#define MAX_CLIENTS 16 /* listen backlog, of each worker */
+#define WORKERS 0 /* accept threads, 0 for one per cpu */
+#define MAX_CONNECTIONS 256 /* served at once, the next ones get 503 */
+#define READ_TIMEOUT 10000 /* ms to send a request, or to keep idle */
+#define WRITE_TIMEOUT 10000 /* ms for each send to a client that does not read */
+#define CONNECTION_STACK 256 * 1024 /* stack of connection threads */
+#define MAX_LISTS 32 /* lists loaded at once by the daemon */
+#define BUFSIZE 1024 * 1024 /* IO buffer, requests heads can use 1/64 */
+#define ASSETS_MAX_AGE 3600 /* seconds browsers cache assets */
+#define REMIND_BEFORE 0 /* minutes before tasks are due they are reminded */
+#define REMIND_EVENTS 64 /* last reminders kept for /api/events clients */
+#define EVENTS_KEEP_ALIVE 15 /* seconds between comments to idle /api/events clients */
+#define LIST_NAME_MAX 64
 
-/* Please note that modifying this macro would break all previously
+/* Please note that modifying this format would break all previously
  * loaded tasks. As tasks are not modificable, changing this variable
  * invalidates all yet created tasks. It can be modified if needed. */
 #define DATETIME_FORMAT "%c"
 #define DATETIME_MAXLEN 64
+
+/* The html page shows the occurrences of recurring tasks in the next
+ * RECUR_VIEW_DAYS days. Listings show at most RECUR_MAX_OCCURRENCES
+ * occurrences of the same task. */
+#define RECUR_VIEW_DAYS 7
+#define RECUR_MAX_OCCURRENCES 1000
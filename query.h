@@ -0,0 +1,469 @@
+#ifndef QUERY_H_
+#define QUERY_H_
+
+/* query.h -- task filter language
+ *
+ * Author: Hugo Coto Florez
+ * Repo: https://github.com/hugootoflorez/todo
+ * License: licenseless
+ *
+ * A query is compiled once into a postfix program and evaluated column
+ * at a time over a struct of arrays view of the tasks: every instruction
+ * produces a bitmap with one bit per task, so the inner loops are flat
+ * comparisons over contiguous arrays and boolean operators are word wide
+ * AND/OR/NOT over bitmaps. Tags are bitmaps in the view itself. Date
+ * comparisons are ranges selected with range.h, that has to be
+ * implemented too (RANGE_IMPLEMENTATION).
+ *
+ * Grammar:
+ *   expr   := term ("or" term)*
+ *   term   := factor (["and"] factor)*
+ *   factor := "not" factor | "(" expr ")" | atom
+ *   atom   := "due" cmp date | "prio" cmp number | "tag:" name
+ *   cmp    := "<" | "<=" | ">" | ">=" | "=" | "!="
+ *   date   := "now" | "today" | "tomorrow" | YYYY-MM-DD | [+-]N("h"|"d"|"w")
+ *
+ * Relative dates are relative to NOW. "today" and YYYY-MM-DD are the
+ * first second of the day, so "due<tomorrow" are the tasks due today or
+ * before.
+ *
+ * Example:
+ *   due<+7d and tag:ops and prio>=2
+ */
+
+#include <stdint.h>
+#include <time.h>
+
+#include "range.h"
+
+enum query_op {
+        QUERY_DUE = 0,
+        QUERY_PRIO,
+        QUERY_TAG,
+        QUERY_AND,
+        QUERY_OR,
+        QUERY_NOT,
+};
+
+enum query_cmp {
+        QUERY_LT = 0,
+        QUERY_LE,
+        QUERY_GT,
+        QUERY_GE,
+        QUERY_EQ,
+        QUERY_NE,
+};
+
+typedef struct {
+        enum query_op op;
+        enum query_cmp cmp;
+        int64_t value; /* time, priority or tag slot */
+} Query_Ins;
+
+typedef struct {
+        Query_Ins *code;
+        int size;
+        int capacity;
+        /* Tags used by the query. Instruction values are indexes here */
+        char **tags;
+        int tags_size;
+        int depth; /* max stack depth */
+} Query;
+
+/* Columns the query is evaluated over. TAGS[i] is the bitmap of the tasks
+ * that have the tag Query.tags[i] */
+typedef struct {
+        int size;
+        const time_t *due;
+        const int *prio;
+        uint64_t **tags;
+} Query_Columns;
+
+#define QUERY_WORDS(n) (((n) + 63) / 64)
+
+/* Compile SRC into Q. Returns 0 on success, or -1 and an error message
+ * in *ERROR */
+int query_compile(Query *q, const char *src, time_t now, const char **error);
+/* Set in OUT (QUERY_WORDS(cols->size) words) the bits of the matching
+ * tasks */
+void query_eval(Query *q, Query_Columns *cols, uint64_t *out);
+void query_destroy(Query *q);
+
+#endif // QUERY_H_
+
+#ifdef QUERY_IMPLEMENTATION
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+        Query *q;
+        const char *c;
+        time_t now;
+        const char *error;
+        int depth;
+} Query_Parser;
+
+static void query_parse_expr(Query_Parser *p);
+
+static void
+query_emit(Query_Parser *p, enum query_op op, enum query_cmp cmp, int64_t value)
+{
+        Query *q = p->q;
+
+        if (q->size == q->capacity) {
+                q->capacity = q->capacity ? q->capacity * 2 : 16;
+                q->code = realloc(q->code, q->capacity * sizeof *q->code);
+                assert(q->code);
+        }
+        q->code[q->size++] = (Query_Ins) { .op = op, .cmp = cmp, .value = value };
+
+        /* Track how many bitmaps evaluation needs */
+        if (op == QUERY_AND || op == QUERY_OR)
+                --p->depth;
+        else if (op != QUERY_NOT && ++p->depth > q->depth)
+                q->depth = p->depth;
+}
+
+static void
+query_skip_spaces(Query_Parser *p)
+{
+        while (isspace((unsigned char) *p->c))
+                ++p->c;
+}
+
+/* Check if keyword KW is the next word */
+static int
+query_peek(Query_Parser *p, const char *kw)
+{
+        size_t n = strlen(kw);
+        query_skip_spaces(p);
+        return strncmp(p->c, kw, n) == 0 && !isalnum((unsigned char) p->c[n]) && p->c[n] != '_';
+}
+
+/* Consume keyword KW if it is the next word */
+static int
+query_accept(Query_Parser *p, const char *kw)
+{
+        if (query_peek(p, kw)) {
+                p->c += strlen(kw);
+                return 1;
+        }
+        return 0;
+}
+
+static int
+query_parse_cmp(Query_Parser *p, enum query_cmp *cmp)
+{
+        query_skip_spaces(p);
+        if (strncmp(p->c, "<=", 2) == 0)
+                *cmp = QUERY_LE, p->c += 2;
+        else if (strncmp(p->c, ">=", 2) == 0)
+                *cmp = QUERY_GE, p->c += 2;
+        else if (strncmp(p->c, "!=", 2) == 0)
+                *cmp = QUERY_NE, p->c += 2;
+        else if (*p->c == '<')
+                *cmp = QUERY_LT, ++p->c;
+        else if (*p->c == '>')
+                *cmp = QUERY_GT, ++p->c;
+        else if (*p->c == '=')
+                *cmp = QUERY_EQ, ++p->c;
+        else {
+                p->error = "expected comparison operator";
+                return -1;
+        }
+        return 0;
+}
+
+static time_t
+query_day_start(time_t t, int add_days)
+{
+        struct tm tm;
+        localtime_r(&t, &tm);
+        tm.tm_mday += add_days;
+        tm.tm_hour = 0;
+        tm.tm_min = 0;
+        tm.tm_sec = 0;
+        tm.tm_isdst = -1; // determine if summer time is in use (+-1h)
+        return mktime(&tm);
+}
+
+static int
+query_parse_date(Query_Parser *p, time_t *out)
+{
+        struct tm tm = { 0 };
+        char *end;
+        long n;
+        int len;
+
+        query_skip_spaces(p);
+        if (query_accept(p, "now"))
+                *out = p->now;
+        else if (query_accept(p, "today"))
+                *out = query_day_start(p->now, 0);
+        else if (query_accept(p, "tomorrow"))
+                *out = query_day_start(p->now, 1);
+        else if (sscanf(p->c, "%4d-%2d-%2d%n", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &len) == 3) {
+                tm.tm_year -= 1900;
+                tm.tm_mon -= 1;
+                tm.tm_isdst = -1;
+                *out = mktime(&tm);
+                p->c += len;
+        } else if (*p->c == '+' || *p->c == '-') {
+                n = strtol(p->c, &end, 10);
+                switch (end != p->c + 1 ? *end : 0) {
+                case 'h':
+                        *out = p->now + n * 3600;
+                        break;
+                case 'd':
+                        *out = p->now + n * 24 * 3600;
+                        break;
+                case 'w':
+                        *out = p->now + n * 7 * 24 * 3600;
+                        break;
+                default:
+                        p->error = "expected h, d or w after relative date";
+                        return -1;
+                }
+                p->c = end + 1;
+        } else {
+                p->error = "expected date";
+                return -1;
+        }
+        return 0;
+}
+
+static void
+query_parse_atom(Query_Parser *p)
+{
+        enum query_cmp cmp;
+        time_t date;
+        const char *start;
+        char *end;
+        long n;
+        int slot;
+
+        query_skip_spaces(p);
+
+        if (query_accept(p, "due")) {
+                if (query_parse_cmp(p, &cmp) || query_parse_date(p, &date))
+                        return;
+                query_emit(p, QUERY_DUE, cmp, date);
+        }
+
+        else if (query_accept(p, "prio")) {
+                if (query_parse_cmp(p, &cmp))
+                        return;
+                n = strtol(p->c, &end, 10);
+                if (end == p->c) {
+                        p->error = "expected priority number";
+                        return;
+                }
+                p->c = end;
+                query_emit(p, QUERY_PRIO, cmp, n);
+        }
+
+        else if (strncmp(p->c, "tag:", 4) == 0) {
+                p->c += 4;
+                start = p->c;
+                while (*p->c && !isspace((unsigned char) *p->c) && *p->c != '(' && *p->c != ')' && *p->c != ',')
+                        ++p->c;
+                if (p->c == start) {
+                        p->error = "expected tag name";
+                        return;
+                }
+                for (slot = 0; slot < p->q->tags_size; slot++)
+                        if (strncmp(p->q->tags[slot], start, p->c - start) == 0 &&
+                            p->q->tags[slot][p->c - start] == 0)
+                                break;
+                if (slot == p->q->tags_size) {
+                        p->q->tags = realloc(p->q->tags, (slot + 1) * sizeof *p->q->tags);
+                        assert(p->q->tags);
+                        p->q->tags[slot] = strndup(start, p->c - start);
+                        assert(p->q->tags[slot]);
+                        ++p->q->tags_size;
+                }
+                query_emit(p, QUERY_TAG, QUERY_EQ, slot);
+        }
+
+        else
+                p->error = "expected due, prio or tag:";
+}
+
+static void
+query_parse_factor(Query_Parser *p)
+{
+        if (query_accept(p, "not")) {
+                query_parse_factor(p);
+                if (!p->error)
+                        query_emit(p, QUERY_NOT, 0, 0);
+                return;
+        }
+
+        query_skip_spaces(p);
+        if (*p->c == '(') {
+                ++p->c;
+                query_parse_expr(p);
+                query_skip_spaces(p);
+                if (*p->c == ')')
+                        ++p->c;
+                else if (!p->error)
+                        p->error = "expected )";
+                return;
+        }
+
+        query_parse_atom(p);
+}
+
+static void
+query_parse_term(Query_Parser *p)
+{
+        query_parse_factor(p);
+        while (!p->error) {
+                query_skip_spaces(p);
+                if (*p->c == 0 || *p->c == ')' || query_peek(p, "or"))
+                        return;
+                /* "and" is optional: "tag:ops prio>1" */
+                query_accept(p, "and");
+                query_parse_factor(p);
+                if (!p->error)
+                        query_emit(p, QUERY_AND, 0, 0);
+        }
+}
+
+static void
+query_parse_expr(Query_Parser *p)
+{
+        query_parse_term(p);
+        while (!p->error && query_accept(p, "or")) {
+                query_parse_term(p);
+                if (!p->error)
+                        query_emit(p, QUERY_OR, 0, 0);
+        }
+}
+
+int
+query_compile(Query *q, const char *src, time_t now, const char **error)
+{
+        Query_Parser p = { .q = q, .c = src, .now = now };
+
+        memset(q, 0, sizeof *q);
+        query_parse_expr(&p);
+        query_skip_spaces(&p);
+        if (!p.error && *p.c)
+                p.error = "unexpected input";
+
+        if (p.error) {
+                *error = p.error;
+                query_destroy(q);
+                return -1;
+        }
+        return 0;
+}
+
+#define QUERY_CMP_LOOP(column, cmp_op, value)                                 \
+        for (int w = 0, i = 0; w < words; w++) {                              \
+                uint64_t m = 0;                                               \
+                for (int b = 0; b < 64 && i < cols->size; b++, i++)           \
+                        m |= (uint64_t) ((column)[i] cmp_op (value)) << b;    \
+                dst[w] = m;                                                   \
+        }
+
+static void
+query_eval_cmp(uint64_t *dst, int words, Query_Columns *cols, const Query_Ins *ins)
+{
+        if (ins->op == QUERY_DUE) {
+                time_t v = ins->value;
+                switch (ins->cmp) {
+                case QUERY_LT: range_select(cols->due, cols->size, RANGE_TIME_MIN, v - 1, dst); break;
+                case QUERY_LE: range_select(cols->due, cols->size, RANGE_TIME_MIN, v, dst); break;
+                case QUERY_GT: range_select(cols->due, cols->size, v + 1, RANGE_TIME_MAX, dst); break;
+                case QUERY_GE: range_select(cols->due, cols->size, v, RANGE_TIME_MAX, dst); break;
+                case QUERY_EQ: range_select(cols->due, cols->size, v, v, dst); break;
+                case QUERY_NE:
+                        range_select(cols->due, cols->size, v, v, dst);
+                        for (int w = 0; w < words; w++)
+                                dst[w] = ~dst[w];
+                        if (cols->size % 64)
+                                dst[words - 1] &= (1ull << cols->size % 64) - 1;
+                        break;
+                }
+        } else {
+                int v = ins->value;
+                switch (ins->cmp) {
+                case QUERY_LT: QUERY_CMP_LOOP(cols->prio, <, v); break;
+                case QUERY_LE: QUERY_CMP_LOOP(cols->prio, <=, v); break;
+                case QUERY_GT: QUERY_CMP_LOOP(cols->prio, >, v); break;
+                case QUERY_GE: QUERY_CMP_LOOP(cols->prio, >=, v); break;
+                case QUERY_EQ: QUERY_CMP_LOOP(cols->prio, ==, v); break;
+                case QUERY_NE: QUERY_CMP_LOOP(cols->prio, !=, v); break;
+                }
+        }
+}
+
+void
+query_eval(Query *q, Query_Columns *cols, uint64_t *out)
+{
+        int words = QUERY_WORDS(cols->size);
+        uint64_t *stack;
+        uint64_t *dst;
+        uint64_t *src;
+        int sp = 0;
+
+        if (q->size == 0 || words == 0) {
+                memset(out, 0, words * sizeof *out);
+                return;
+        }
+
+        stack = malloc(q->depth * words * sizeof *stack);
+        assert(stack);
+        for (int pc = 0; pc < q->size; pc++) {
+                const Query_Ins *ins = &q->code[pc];
+                switch (ins->op) {
+                case QUERY_DUE:
+                case QUERY_PRIO:
+                        query_eval_cmp(stack + sp++ * words, words, cols, ins);
+                        break;
+                case QUERY_TAG:
+                        memcpy(stack + sp++ * words, cols->tags[ins->value], words * sizeof *stack);
+                        break;
+                case QUERY_AND:
+                        src = stack + --sp * words;
+                        dst = src - words;
+                        for (int w = 0; w < words; w++)
+                                dst[w] &= src[w];
+                        break;
+                case QUERY_OR:
+                        src = stack + --sp * words;
+                        dst = src - words;
+                        for (int w = 0; w < words; w++)
+                                dst[w] |= src[w];
+                        break;
+                case QUERY_NOT:
+                        dst = stack + (sp - 1) * words;
+                        for (int w = 0; w < words; w++)
+                                dst[w] = ~dst[w];
+                        /* Clear bits past the last task */
+                        if (cols->size % 64)
+                                dst[words - 1] &= (1ull << cols->size % 64) - 1;
+                        break;
+                }
+        }
+
+        memcpy(out, stack, words * sizeof *out);
+        free(stack);
+}
+
+void
+query_destroy(Query *q)
+{
+        for (int i = 0; i < q->tags_size; i++)
+                free(q->tags[i]);
+        free(q->tags);
+        free(q->code);
+        memset(q, 0, sizeof *q);
+}
+
+#endif // QUERY_IMPLEMENTATION
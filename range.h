@@ -0,0 +1,181 @@
+#ifndef RANGE_H_
+#define RANGE_H_
+
+/* range.h -- vectorized date range selection
+ *
+ * Author: Hugo Coto Florez
+ * Repo: https://github.com/hugootoflorez/todo
+ * License: licenseless
+ *
+ * range_select() compares a column of dates against a closed range and
+ * writes a bitmap with one bit per date, the same layout query.h uses.
+ * LO <= V <= HI is checked with a single unsigned compare of V - LO
+ * against HI - LO, that SIMD does as a signed compare after flipping the
+ * sign bit. The kernel is chosen once, from what the cpu supports: AVX2
+ * (4 dates per compare), SSE4.2 (2 dates per compare, pcmpgtq) or a
+ * scalar loop.
+ *
+ * Usage:
+ *   uint64_t mask[RANGE_WORDS(n)];
+ *   range_select(due, n, RANGE_TIME_MIN, now, mask); // overdue
+ */
+
+#include <stdint.h>
+#include <time.h>
+
+enum range_impl {
+        RANGE_SCALAR = 0,
+        RANGE_SSE42,
+        RANGE_AVX2,
+        RANGE_IMPL_COUNT,
+};
+
+#define RANGE_WORDS(n) (((n) + 63) / 64)
+#define RANGE_TIME_MIN ((time_t) INT64_MIN)
+#define RANGE_TIME_MAX ((time_t) INT64_MAX)
+
+extern const char *range_impl_names[RANGE_IMPL_COUNT];
+
+/* Set bit I of MASK if LO <= V[I] <= HI, for I < N. MASK has to have
+ * RANGE_WORDS(N) words. Bits past N are cleared. */
+void range_select(const time_t *v, int n, time_t lo, time_t hi, uint64_t *mask);
+/* Same, with a given kernel. Kernels the cpu does not support fall back
+ * to the scalar one */
+void range_select_impl(enum range_impl impl, const time_t *v, int n, time_t lo, time_t hi, uint64_t *mask);
+/* Best kernel for this cpu */
+enum range_impl range_best_impl(void);
+
+#endif // RANGE_H_
+
+/* query.h includes this header too */
+#if defined(RANGE_IMPLEMENTATION) && !defined(RANGE_IMPLEMENTATION_DONE)
+#define RANGE_IMPLEMENTATION_DONE
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RANGE_X86 1
+#endif
+
+_Static_assert(sizeof(time_t) == sizeof(int64_t), "range.h needs a 64 bit time_t");
+
+const char *range_impl_names[RANGE_IMPL_COUNT] = {
+        [RANGE_SCALAR] = "scalar",
+        [RANGE_SSE42] = "sse4.2",
+        [RANGE_AVX2] = "avx2",
+};
+
+static void
+range_select_scalar(const time_t *v, int n, time_t lo, time_t hi, uint64_t *mask)
+{
+        uint64_t range = (uint64_t) hi - (uint64_t) lo;
+        for (int w = 0, i = 0; i < n; w++) {
+                uint64_t m = 0;
+                for (int b = 0; b < 64 && i < n; b++, i++)
+                        m |= (uint64_t) ((uint64_t) v[i] - (uint64_t) lo <= range) << b;
+                mask[w] = m;
+        }
+}
+
+#ifdef RANGE_X86
+__attribute__((target("sse4.2"))) static void
+range_select_sse42(const time_t *v, int n, time_t lo, time_t hi, uint64_t *mask)
+{
+        const __m128i sign = _mm_set1_epi64x(INT64_MIN);
+        const __m128i vlo = _mm_set1_epi64x(lo);
+        const __m128i vrange = _mm_set1_epi64x(((uint64_t) hi - (uint64_t) lo) ^ (1ull << 63));
+        int full = n / 64;
+        __m128i x;
+
+        for (int w = 0; w < full; w++) {
+                uint64_t out = 0;
+                for (int b = 0; b < 64; b += 2) {
+                        x = _mm_loadu_si128((const __m128i *) (v + w * 64 + b));
+                        x = _mm_xor_si128(_mm_sub_epi64(x, vlo), sign);
+                        x = _mm_cmpgt_epi64(x, vrange);
+                        out |= (uint64_t) _mm_movemask_pd(_mm_castsi128_pd(x)) << b;
+                }
+                mask[w] = ~out;
+        }
+        if (n % 64)
+                range_select_scalar(v + full * 64, n % 64, lo, hi, mask + full);
+}
+
+__attribute__((target("avx2"))) static void
+range_select_avx2(const time_t *v, int n, time_t lo, time_t hi, uint64_t *mask)
+{
+        const __m256i sign = _mm256_set1_epi64x(INT64_MIN);
+        const __m256i vlo = _mm256_set1_epi64x(lo);
+        const __m256i vrange = _mm256_set1_epi64x(((uint64_t) hi - (uint64_t) lo) ^ (1ull << 63));
+        int full = n / 64;
+        __m256i x;
+
+        for (int w = 0; w < full; w++) {
+                uint64_t out = 0;
+                for (int b = 0; b < 64; b += 4) {
+                        x = _mm256_loadu_si256((const __m256i *) (v + w * 64 + b));
+                        x = _mm256_xor_si256(_mm256_sub_epi64(x, vlo), sign);
+                        x = _mm256_cmpgt_epi64(x, vrange);
+                        out |= (uint64_t) _mm256_movemask_pd(_mm256_castsi256_pd(x)) << b;
+                }
+                mask[w] = ~out;
+        }
+        if (n % 64)
+                range_select_scalar(v + full * 64, n % 64, lo, hi, mask + full);
+}
+#endif // RANGE_X86
+
+enum range_impl
+range_best_impl(void)
+{
+        /* Benign race: every thread computes the same value */
+        static int best = -1;
+        int impl = __atomic_load_n(&best, __ATOMIC_RELAXED);
+
+        if (impl >= 0)
+                return impl;
+        impl = RANGE_SCALAR;
+#ifdef RANGE_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+                impl = RANGE_AVX2;
+        else if (__builtin_cpu_supports("sse4.2"))
+                impl = RANGE_SSE42;
+#endif
+        __atomic_store_n(&best, impl, __ATOMIC_RELAXED);
+        return impl;
+}
+
+void
+range_select_impl(enum range_impl impl, const time_t *v, int n, time_t lo, time_t hi, uint64_t *mask)
+{
+        if (lo > hi) {
+                memset(mask, 0, RANGE_WORDS(n) * sizeof *mask);
+                return;
+        }
+        if (impl > range_best_impl())
+                impl = RANGE_SCALAR;
+
+        switch (impl) {
+#ifdef RANGE_X86
+        case RANGE_AVX2:
+                range_select_avx2(v, n, lo, hi, mask);
+                break;
+        case RANGE_SSE42:
+                range_select_sse42(v, n, lo, hi, mask);
+                break;
+#endif
+        default:
+                range_select_scalar(v, n, lo, hi, mask);
+                break;
+        }
+}
+
+void
+range_select(const time_t *v, int n, time_t lo, time_t hi, uint64_t *mask)
+{
+        range_select_impl(range_best_impl(), v, n, lo, hi, mask);
+}
+
+#endif // RANGE_IMPLEMENTATION
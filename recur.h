@@ -0,0 +1,343 @@
+#ifndef RECUR_H_
+#define RECUR_H_
+
+/* recur.h -- recurrence rules for repeating tasks
+ *
+ * Author: Hugo Coto Florez
+ * Repo: https://github.com/hugootoflorez/todo
+ * License: licenseless
+ *
+ * A rule is stored once, next to the first occurrence of the task (the
+ * anchor), and occurrences are computed when they are needed, so a daily
+ * chore costs the same to load and save as any other task.
+ *
+ * Rules:
+ *   daily | weekly | monthly [on D]
+ *   every N (days | weeks | months) [on D]
+ *   cron MIN HOUR DOM MON DOW
+ *
+ * Periodic rules repeat at the time of day of the anchor. Months without
+ * day D use their last day. Cron fields accept '*', numbers, ranges A-B,
+ * lists A,B and steps A-B/S ('*' can have a step too), as crontab(5). As
+ * there, if both DOM and DOW are restricted, a day matches if any of them
+ * does.
+ *
+ * Usage:
+ *   Recur r;
+ *   recur_parse(&r, "every 2 weeks", &error);
+ *   next = recur_next(&r, due, time(NULL));
+ */
+
+#include <stdint.h>
+#include <time.h>
+
+enum recur_kind {
+        RECUR_NONE = 0,
+        RECUR_DAYS,
+        RECUR_WEEKS,
+        RECUR_MONTHS,
+        RECUR_CRON,
+};
+
+typedef struct {
+        enum recur_kind kind;
+        int every; /* periodic rules: every EVERY units */
+        int mday; /* months: day of the month, 0 for the day of the anchor */
+        /* cron: bit I is set if I is allowed */
+        uint64_t minutes;
+        uint32_t hours;
+        uint32_t mdays;
+        uint16_t months;
+        uint8_t wdays; /* sunday is 0 */
+        uint8_t any_mday;
+        uint8_t any_wday;
+} Recur;
+
+/* Days a cron rule is searched for a match before giving up */
+#define RECUR_CRON_DAYS (5 * 366)
+
+/* Parse SRC into R. Returns 0 on success, or -1 and an error message in
+ * *ERROR */
+int recur_parse(Recur *r, const char *src, const char **error);
+/* First occurrence after AFTER of the task first due at ANCHOR, or -1 if
+ * there is none */
+time_t recur_next(const Recur *r, time_t anchor, time_t after);
+
+#endif // RECUR_H_
+
+#ifdef RECUR_IMPLEMENTATION
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+/* Parse a cron field with values in [LO, HI] into *BITS. Returns the
+ * position after the field or NULL on error */
+static const char *
+recur_parse_field(const char *c, int lo, int hi, uint64_t *bits)
+{
+        long a, b, step;
+        char *end;
+
+        *bits = 0;
+        c += strspn(c, " \t");
+        do {
+                if (*c == '*') {
+                        a = lo;
+                        b = hi;
+                        ++c;
+                } else {
+                        a = b = strtol(c, &end, 10);
+                        if (end == c)
+                                return NULL;
+                        c = end;
+                        if (*c == '-') {
+                                b = strtol(c + 1, &end, 10);
+                                if (end == c + 1)
+                                        return NULL;
+                                c = end;
+                        }
+                }
+                step = 1;
+                if (*c == '/') {
+                        step = strtol(c + 1, &end, 10);
+                        if (end == c + 1 || step <= 0)
+                                return NULL;
+                        c = end;
+                }
+                if (a < lo || b > hi || a > b)
+                        return NULL;
+                for (long i = a; i <= b; i += step)
+                        *bits |= 1ull << i;
+        } while (*c == ',' && ++c);
+
+        if (*c && !isspace((unsigned char) *c))
+                return NULL;
+        return c;
+}
+
+static int
+recur_parse_cron(Recur *r, const char *c, const char **error)
+{
+        static const struct {
+                int lo, hi;
+                const char *error;
+        } fields[] = {
+                { 0, 59, "invalid cron minute" },
+                { 0, 23, "invalid cron hour" },
+                { 1, 31, "invalid cron day of month" },
+                { 1, 12, "invalid cron month" },
+                { 0, 7, "invalid cron day of week" },
+        };
+        uint64_t bits[5];
+
+        for (int i = 0; i < 5; i++) {
+                c += strspn(c, " \t");
+                if (i == 2)
+                        r->any_mday = *c == '*';
+                if (i == 4)
+                        r->any_wday = *c == '*';
+                if ((c = recur_parse_field(c, fields[i].lo, fields[i].hi, &bits[i])) == NULL) {
+                        *error = fields[i].error;
+                        return -1;
+                }
+        }
+        if (c[strspn(c, " \t\n")]) {
+                *error = "cron rules have 5 fields";
+                return -1;
+        }
+
+        r->kind = RECUR_CRON;
+        r->minutes = bits[0];
+        r->hours = bits[1];
+        r->mdays = bits[2];
+        r->months = bits[3];
+        /* 7 is sunday too */
+        r->wdays = (bits[4] | bits[4] >> 7) & 0x7f;
+        return 0;
+}
+
+int
+recur_parse(Recur *r, const char *src, const char **error)
+{
+        const char *c = src + strspn(src, " \t");
+        char word[16] = "";
+        char *end;
+        int n;
+
+        memset(r, 0, sizeof *r);
+        r->every = 1;
+        *error = NULL;
+
+        if (strncasecmp(c, "cron", 4) == 0 && isspace((unsigned char) c[4]))
+                return recur_parse_cron(r, c + 4, error);
+
+        if (strncasecmp(c, "every", 5) == 0 && isspace((unsigned char) c[5])) {
+                r->every = strtol(c + 5, &end, 10);
+                if (end == c + 5 || r->every <= 0) {
+                        *error = "expected a number after every";
+                        return -1;
+                }
+                c = end;
+        }
+
+        c += strspn(c, " \t");
+        for (n = 0; isalpha((unsigned char) c[n]) && n < (int) sizeof word - 1; n++)
+                word[n] = tolower((unsigned char) c[n]);
+        word[n] = 0;
+        c += n;
+
+        if (!strcmp(word, "daily") || !strcmp(word, "day") || !strcmp(word, "days"))
+                r->kind = RECUR_DAYS;
+        else if (!strcmp(word, "weekly") || !strcmp(word, "week") || !strcmp(word, "weeks"))
+                r->kind = RECUR_WEEKS;
+        else if (!strcmp(word, "monthly") || !strcmp(word, "month") || !strcmp(word, "months"))
+                r->kind = RECUR_MONTHS;
+        else {
+                *error = "expected daily, weekly, monthly, every N days|weeks|months or cron";
+                return -1;
+        }
+
+        c += strspn(c, " \t");
+        if (r->kind == RECUR_MONTHS && strncasecmp(c, "on", 2) == 0) {
+                r->mday = strtol(c + 2, &end, 10);
+                if (end == c + 2 || r->mday < 1 || r->mday > 31) {
+                        *error = "expected a day of the month after on";
+                        return -1;
+                }
+                c = end;
+        }
+
+        if (c[strspn(c, " \t\n")]) {
+                *error = "unexpected text after the rule";
+                return -1;
+        }
+        return 0;
+}
+
+static int
+recur_days_in_month(int year, int mon)
+{
+        static const int days[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+        year += 1900;
+        if (mon == 1 && (year % 4 == 0 && (year % 100 != 0 || year % 400 == 0)))
+                return 29;
+        return days[mon];
+}
+
+static time_t
+recur_next_periodic(const Recur *r, time_t anchor, time_t after)
+{
+        struct tm a;
+        struct tm t;
+        struct tm now;
+        time_t occ;
+        long k = 0;
+        int day;
+
+        localtime_r(&anchor, &a);
+
+        /* Start one period before the estimate, so DST changes can not
+         * make it skip an occurrence */
+        if (r->kind == RECUR_MONTHS) {
+                localtime_r(&after, &now);
+                if (after > anchor)
+                        k = ((now.tm_year - a.tm_year) * 12L + now.tm_mon - a.tm_mon) / r->every - 1;
+        } else if (after > anchor) {
+                k = (after - anchor) / (r->every * (r->kind == RECUR_WEEKS ? 7 : 1) * 86400L) - 1;
+        }
+        if (k < 0)
+                k = 0;
+
+        for (;; k++) {
+                t = a;
+                t.tm_isdst = -1;
+                if (r->kind == RECUR_MONTHS) {
+                        day = r->mday ? r->mday : a.tm_mday;
+                        t.tm_mday = 1;
+                        t.tm_mon += k * r->every;
+                        mktime(&t);
+                        t.tm_mday = day < recur_days_in_month(t.tm_year, t.tm_mon) ? day : recur_days_in_month(t.tm_year, t.tm_mon);
+                        t.tm_hour = a.tm_hour;
+                        t.tm_min = a.tm_min;
+                        t.tm_sec = a.tm_sec;
+                        t.tm_isdst = -1;
+                } else {
+                        t.tm_mday += k * r->every * (r->kind == RECUR_WEEKS ? 7 : 1);
+                }
+                if ((occ = mktime(&t)) > after)
+                        return occ;
+        }
+}
+
+static int
+recur_cron_day(const Recur *r, const struct tm *tm)
+{
+        int mday = r->mdays >> tm->tm_mday & 1;
+        int wday = r->wdays >> tm->tm_wday & 1;
+
+        if (!(r->months >> (tm->tm_mon + 1) & 1))
+                return 0;
+        if (!r->any_mday && !r->any_wday)
+                return mday || wday;
+        return mday && wday;
+}
+
+static time_t
+recur_next_cron(const Recur *r, time_t anchor, time_t after)
+{
+        struct tm tm;
+        struct tm o;
+        time_t t = after < anchor ? anchor - 1 : after;
+
+        /* Next whole minute after T */
+        localtime_r(&t, &tm);
+        tm.tm_sec = 0;
+        ++tm.tm_min;
+        tm.tm_isdst = -1;
+        mktime(&tm);
+
+        for (int day = 0; day < RECUR_CRON_DAYS; day++) {
+                if (day) {
+                        ++tm.tm_mday;
+                        tm.tm_hour = 0;
+                        tm.tm_min = 0;
+                        tm.tm_isdst = -1;
+                        mktime(&tm);
+                }
+                if (!recur_cron_day(r, &tm))
+                        continue;
+                for (int h = tm.tm_hour; h < 24; h++) {
+                        if (!(r->hours >> h & 1))
+                                continue;
+                        for (int m = h == tm.tm_hour ? tm.tm_min : 0; m < 60; m++) {
+                                if (!(r->minutes >> m & 1))
+                                        continue;
+                                o = tm;
+                                o.tm_hour = h;
+                                o.tm_min = m;
+                                o.tm_isdst = -1;
+                                return mktime(&o);
+                        }
+                }
+        }
+        return -1;
+}
+
+time_t
+recur_next(const Recur *r, time_t anchor, time_t after)
+{
+        switch (r->kind) {
+        case RECUR_DAYS:
+        case RECUR_WEEKS:
+        case RECUR_MONTHS:
+                return recur_next_periodic(r, anchor, after);
+        case RECUR_CRON:
+                return recur_next_cron(r, anchor, after);
+        default:
+                return -1;
+        }
+}
+
+#endif // RECUR_IMPLEMENTATION
@@ -15,14 +15,18 @@
  * and greater to 499 to use strdup */
 #define _XOPEN_SOURCE 500
 #define _POSIX_C_SOURCE 200809L
+/* CPU affinity of the workers of the daemon */
+#define _GNU_SOURCE
 
 #include <arpa/inet.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <poll.h>
 #include <pthread.h>
-#include <semaphore.h>
+#include <sched.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdbool.h>
@@ -30,18 +34,71 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <sys/file.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
+#include <zlib.h>
 
 #define FLAG_IMPLEMENTATION
 #include "flag.h"
 
+/* Defined by _GNU_SOURCE, frog.h defines it again */
+#undef _DEFAULT_SOURCE
 #include "frog.h"
 
+#define LOG_IMPLEMENTATION
+#include "log.h"
+
+/* frog.h LOG is compile time only, route it to the runtime logger */
+#undef LOG
+#define LOG(...) LOGD(__VA_ARGS__)
+
+#define METRICS_IMPLEMENTATION
+#include "metrics.h"
+
+#define INDEX_IMPLEMENTATION
+#include "index.h"
+
+#define RANGE_IMPLEMENTATION
+#include "range.h"
+
+#define QUERY_IMPLEMENTATION
+#include "query.h"
+
+#define RECUR_IMPLEMENTATION
+#include "recur.h"
+
+#define FORMATS_IMPLEMENTATION
+#include "formats.h"
+
+#define DATE_IMPLEMENTATION
+#include "date.h"
+
+#define HTTP_IMPLEMENTATION
+#include "http.h"
+
+#define TZ_IMPLEMENTATION
+#include "tz.h"
+
+#define WHEEL_IMPLEMENTATION
+#include "wheel.h"
+
 #include "options.h"
 
+/* Marks the functions only called by main(). bench.c includes this file
+ * without main(), see TODO_NO_MAIN */
+#ifdef TODO_NO_MAIN
+#define MAIN_ONLY __attribute__((unused))
+#else
+#define MAIN_ONLY
+#endif
+
 #define TRUNCAT(str, chr)                         \
         do {                                      \
                 char *_c_;                        \
@@ -50,18 +107,129 @@
         } while (0)
 
 
+/* A single task, as it is loaded, added and printed. DATA does not
+ * store tasks like this, see Store. */
 typedef struct {
         time_t due;
         char *name;
         char *desc;
+        char *tags; /* comma separated */
+        char *repeat; /* recurrence rule, see recur.h */
+        int prio;
+        int id; /* Unique while the program runs, not saved */
+        struct reminder *reminder; /* Set by store_add(), see store_remind() */
 } Task;
 
-typedef DA(Task) Task_da;
+/* The task store, as a struct of arrays. Row I of every column is the
+ * same task. Scans and sorts by date only touch the hot scalar columns,
+ * and the strings are only read when a task is printed. */
+typedef struct {
+        time_t *due;
+        int *prio;
+        int *id;
+        char **name;
+        char **desc;
+        char **tags;
+        char **repeat;
+        struct reminder **reminder;
+        int size;
+        int capacity;
+        int next_id;
+        /* Full text index over task names and descriptions. It is built
+         * the first time it is needed and updated by store_add() and
+         * store_remove() */
+        struct {
+                Index ix;
+                bool built;
+        } search;
+        /* Ids of the tasks with each tag, as whole keys. Built the first
+         * time a query uses tags and updated as the search index, see
+         * tasks_where() */
+        struct {
+                Index ix;
+                bool built;
+        } by_tag;
+        /* Done tasks waiting to be archived, see archive_add() */
+        struct {
+                const char *dir; /* NULL to not archive */
+                FILE *stream;
+                char *buf;
+                size_t len;
+                int month; /* year * 12 + month of the buffered tasks */
+        } archive;
+        /* Name of the list of the daemon the tasks are reminded as, NULL
+         * to not remind them, see store_remind() */
+        const char *remind;
+} Store;
+
+#define STORE_COLUMNS(X) X(due) X(prio) X(id) X(name) X(desc) X(tags) X(repeat) X(reminder)
+
+/* Rows of a store, as returned by filters */
+typedef DA(int) Row_da;
 
-Task_da data;
+/* A row of a store at one of its dates. Tasks have a single occurrence,
+ * except recurring ones. */
+typedef struct {
+        time_t due;
+        int row;
+} Occurrence;
+
+typedef DA(Occurrence) Occurrence_da;
+
+/* Tasks of the command line. The daemon has a store per list */
+Store data;
+char **in_file;
 char **out_file;
-char **css_file;
+char **assets_dir;
+char **archive_dir;
+char **lists_dir;
+int *max_lists;
 bool *quiet = NULL;
+/* Set by flags, the config file or the environment, see options.h */
+char **datetime_format;
+char **log_file;
+char **pid_file;
+int *serve_port;
+int *max_attempts;
+int *max_clients;
+size_t *bufsize;
+int *assets_max_age;
+int *workers;
+int *max_connections;
+int *read_timeout;
+int *write_timeout;
+char **control_socket;
+int *remind_before;
+char **remind_exec;
+char **remind_fifo;
+
+/* Daemon metrics, exported at /metrics */
+enum serve_phase {
+        PHASE_ACCEPT = 0,
+        PHASE_PARSE,
+        PHASE_RENDER,
+        PHASE_SEND,
+        PHASE_COUNT,
+};
+
+static Counter m_requests = COUNTER("todo_http_requests_total", "HTTP requests handled", NULL);
+static Counter m_sent_bytes = COUNTER("todo_http_sent_bytes_total", "HTTP body bytes sent", NULL);
+static Counter m_renders = COUNTER("todo_page_renders_total", "Pages rendered because the cache was stale", NULL);
+static Counter m_shed = COUNTER("todo_http_shed_total", "Connections answered with 503 because there were -max_connections", NULL);
+static Counter m_timeouts = COUNTER("todo_http_timeouts_total", "Connections closed because a request did not arrive in -read_timeout", NULL);
+static Counter m_reminders = COUNTER("todo_reminders_total", "Reminders of due tasks fired", NULL);
+/* Connections being served, by all the workers */
+static int connections = 0;
+/* Written when the listening sockets are handed to another daemon, so
+ * workers stop accepting and idle connections are closed */
+static int serve_stop[2] = { -1, -1 };
+static Histogram m_phase[PHASE_COUNT] = {
+        [PHASE_ACCEPT] = HISTOGRAM("todo_http_phase_seconds", "Time spent in each request phase", "phase=\"accept\""),
+        [PHASE_PARSE] = HISTOGRAM("todo_http_phase_seconds", "Time spent in each request phase", "phase=\"parse\""),
+        [PHASE_RENDER] = HISTOGRAM("todo_http_phase_seconds", "Time spent in each request phase", "phase=\"render\""),
+        [PHASE_SEND] = HISTOGRAM("todo_http_phase_seconds", "Time spent in each request phase", "phase=\"send\""),
+};
+static Histogram m_save = HISTOGRAM("todo_save_seconds", "Time spent saving tasks to disk", NULL);
 
 const char *no_tasks_messages[] = {
         "No tasks for this date! Enjoy your free time.",
@@ -77,59 +245,665 @@ const char *no_tasks_messages[] = {
 };
 
 /* I can override this and use it to print so I can avoid printing the year if
- * its the same as the actual and avoid printing the time if its the default */
+ * its the same as the actual and avoid printing the time if its the default.
+ * The buffer is per thread, as lists are rendered and saved at once */
 static char *
 overload_date(time_t time)
 {
-        static char global_datetime_buffer[DATETIME_MAXLEN];
-        strftime(global_datetime_buffer, sizeof global_datetime_buffer - 1, DATETIME_FORMAT, localtime(&time));
+        static _Thread_local char global_datetime_buffer[DATETIME_MAXLEN];
+        struct tm tm;
+        strftime(global_datetime_buffer, sizeof global_datetime_buffer - 1, *datetime_format, tz_localtime(&time, &tm));
         return global_datetime_buffer;
 }
 
+/* Get the task at ROW of DATA. Strings are still owned by DATA */
+static inline Task
+store_get(Store *s, int row)
+{
+        return (Task) {
+                .due = s->due[row],
+                .name = s->name[row],
+                .desc = s->desc[row],
+                .tags = s->tags[row],
+                .repeat = s->repeat[row],
+                .prio = s->prio[row],
+                .id = s->id[row],
+        };
+}
+
+/* Write the task at ROW of DATA in the todo.out format, without the
+ * blank line that ends it */
+static void
+write_task(Store *s, FILE *f, int row)
+{
+        fprintf(f, "[%s]\n", s->name[row]);
+        fprintf(f, "  date: %s\n", overload_date(s->due[row]));
+        if (s->desc[row])
+                fprintf(f, "  desc: %s\n", s->desc[row]);
+        if (s->tags[row])
+                fprintf(f, "  tags: %s\n", s->tags[row]);
+        if (s->prio[row])
+                fprintf(f, "  prio: %d\n", s->prio[row]);
+        if (s->repeat[row])
+                fprintf(f, "  repeat: %s\n", s->repeat[row]);
+}
+
+/* Write the task at ROW of S as a json object, without newline */
+static void
+write_task_json(Store *s, FILE *f, int row)
+{
+        fprintf(f, "{\"id\":%d,\"due\":%lld,\"name\":", s->id[row], (long long) s->due[row]);
+        json_write_str(f, s->name[row]);
+        if (s->desc[row]) {
+                fprintf(f, ",\"desc\":");
+                json_write_str(f, s->desc[row]);
+        }
+        if (s->tags[row]) {
+                fprintf(f, ",\"tags\":");
+                json_write_str(f, s->tags[row]);
+        }
+        if (s->repeat[row]) {
+                fprintf(f, ",\"repeat\":");
+                json_write_str(f, s->repeat[row]);
+        }
+        fprintf(f, ",\"prio\":%d}", s->prio[row]);
+}
+
+/* Completed tasks are appended to the archive directory of the store, in
+ * a gzip file per month of completion (YYYY-MM.gz) that is never loaded by
+ * other commands. Tasks are buffered and each flush appends a new gzip
+ * member, so files are only appended to and zlib reads them as a single
+ * stream. */
+static void
+archive_path(char *path, size_t size, const char *dir, int month)
+{
+        snprintf(path, size, "%s/%04d-%02d.gz", dir, month / 12, month % 12 + 1);
+}
+
+/* Append the buffered tasks to their partition */
+static void
+archive_flush(Store *s)
+{
+        char path[PATH_MAX];
+        gzFile gz;
+
+        if (s->archive.stream == NULL)
+                return;
+        fclose(s->archive.stream);
+        s->archive.stream = NULL;
+
+        mkdir(s->archive.dir, 0755);
+        archive_path(path, sizeof path, s->archive.dir, s->archive.month);
+        if ((gz = gzopen(path, "ab9")) == NULL)
+                LOGE("Can not open archive %s: %s\n", path, strerror(errno));
+        else {
+                if (gzwrite(gz, s->archive.buf, s->archive.len) != (int) s->archive.len)
+                        LOGE("Can not write archive %s\n", path);
+                gzclose(gz);
+        }
+        free(s->archive.buf);
+        s->archive.buf = NULL;
+        s->archive.len = 0;
+}
+
+/* Buffer the task at ROW to be archived as done at DONE. It is written
+ * with the next save. Does nothing if there is no archive directory. */
+static void
+archive_add(Store *s, int row, time_t done)
+{
+        struct tm tm;
+        int month;
+
+        if (s->archive.dir == NULL)
+                return;
+
+        tz_localtime(&done, &tm);
+        month = (tm.tm_year + 1900) * 12 + tm.tm_mon;
+        if (s->archive.stream && s->archive.month != month)
+                archive_flush(s);
+        if (s->archive.stream == NULL) {
+                s->archive.stream = open_memstream(&s->archive.buf, &s->archive.len);
+                assert(s->archive.stream);
+                s->archive.month = month;
+        }
+        write_task(s, s->archive.stream, row);
+        fprintf(s->archive.stream, "  done: %s\n\n", overload_date(done));
+}
+
+/* Reminder of a task of a list of the daemon, that fires -remind_before
+ * minutes before the task is due. Pending ones are in REMINDERS.WHEEL */
+struct reminder {
+        Wheel_Timer timer;
+        time_t due;
+        const char *list; /* name of the list, valid while it is loaded */
+        char name[];
+};
+
+/* Reminders of the tasks of every list. The lock of a list can be held
+ * while taking REMINDERS.LOCK, but not the other way around */
+static struct {
+        pthread_mutex_t lock;
+        Wheel wheel;
+        bool running; /* set by reminders_start() */
+} reminders = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/* Cancel and free the reminder of the task at ROW of S, if it has one */
+static void
+store_forget(Store *s, int row)
+{
+        if (s->reminder[row] == NULL)
+                return;
+        pthread_mutex_lock(&reminders.lock);
+        wheel_cancel(&s->reminder[row]->timer);
+        pthread_mutex_unlock(&reminders.lock);
+        free(s->reminder[row]);
+        s->reminder[row] = NULL;
+}
+
+/* Schedule the reminder of the task at ROW of S again, after it was
+ * added or its date changed. Only tasks of reminded stores that are not
+ * due yet have one. Adding it to the wheel is O(1), see wheel.h */
+static void
+store_remind(Store *s, int row)
+{
+        struct reminder *r;
+
+        store_forget(s, row);
+        if (s->remind == NULL || s->due[row] <= time(NULL))
+                return;
+
+        r = malloc(sizeof *r + strlen(s->name[row]) + 1);
+        assert(r);
+        r->timer = (Wheel_Timer) { 0 };
+        r->due = s->due[row];
+        r->list = s->remind;
+        strcpy(r->name, s->name[row]);
+        pthread_mutex_lock(&reminders.lock);
+        wheel_add(&reminders.wheel, &r->timer, r->due - (time_t) *remind_before * 60);
+        pthread_mutex_unlock(&reminders.lock);
+        s->reminder[row] = r;
+}
+
+/* Add ID to the posting list of each of the comma separated TAGS in IX,
+ * or remove it if not ADD */
+static void
+store_index_tags(Index *ix, int id, const char *tags, bool add)
+{
+        char *copy;
+        char *rest;
+        char *tag;
+
+        if (tags == NULL)
+                return;
+        rest = copy = strdup(tags);
+        assert(copy);
+        while ((tag = strsep(&rest, ","))) {
+                if (*tag == 0)
+                        continue;
+                if (add)
+                        index_add_key(ix, id, tag);
+                else
+                        index_remove_key(ix, id, tag);
+        }
+        free(copy);
+}
+
+/* Every task has to be added to DATA using this function. TASK is owned
+ * by DATA after this call. */
+static void
+store_add(Store *s, Task task)
+{
+        const char *error;
+        char *repeat;
+        Recur r;
+
+        if (task.repeat && recur_parse(&r, task.repeat, &error)) {
+                LOGW("Task %s: can not parse repeat rule '%s': %s\n", task.name, task.repeat, error);
+                free(task.repeat);
+                task.repeat = NULL;
+        }
+        /* Monthly rules keep the day of the first occurrence, that is lost
+         * once the task is done and moves to a shorter month */
+        else if (task.repeat && r.kind == RECUR_MONTHS && r.mday == 0) {
+                struct tm tm;
+                tz_localtime(&task.due, &tm);
+                repeat = malloc(strlen(task.repeat) + 8);
+                assert(repeat);
+                sprintf(repeat, "%s on %d", task.repeat, tm.tm_mday);
+                free(task.repeat);
+                task.repeat = repeat;
+        }
+
+        task.id = s->next_id++;
+        task.reminder = NULL;
+        if (s->search.built) {
+                index_add(&s->search.ix, task.id, task.name);
+                index_add(&s->search.ix, task.id, task.desc);
+        }
+        if (s->by_tag.built)
+                store_index_tags(&s->by_tag.ix, task.id, task.tags, true);
+        if (s->size == s->capacity) {
+                s->capacity = s->capacity ? s->capacity * 2 : 256;
+#define X(col)                                                          \
+        s->col = realloc(s->col, s->capacity * sizeof *s->col); \
+        assert(s->col);
+                STORE_COLUMNS(X)
+#undef X
+        }
+#define X(col) s->col[s->size] = task.col;
+        STORE_COLUMNS(X)
+#undef X
+        store_remind(s, s->size++);
+}
+
+/* Remove and free the task at ROW of DATA. Returns false if ROW is not
+ * a valid row */
+static bool
+store_remove(Store *s, int row)
+{
+        if (row < 0 || row >= s->size)
+                return false;
+
+        if (s->search.built) {
+                index_remove(&s->search.ix, s->id[row], s->name[row]);
+                index_remove(&s->search.ix, s->id[row], s->desc[row]);
+        }
+        if (s->by_tag.built)
+                store_index_tags(&s->by_tag.ix, s->id[row], s->tags[row], false);
+        store_forget(s, row);
+        free(s->name[row]);
+        free(s->desc[row]);
+        free(s->tags[row]);
+        free(s->repeat[row]);
+#define X(col) memmove(s->col + row, s->col + row + 1, (s->size - row - 1) * sizeof *s->col);
+        STORE_COLUMNS(X)
+#undef X
+        --s->size;
+        return true;
+}
+
+static void
+store_clear(Store *s)
+{
+        for (int row = 0; row < s->size; row++) {
+                store_forget(s, row);
+                free(s->name[row]);
+                free(s->desc[row]);
+                free(s->tags[row]);
+                free(s->repeat[row]);
+        }
+        s->size = 0;
+        index_destroy(&s->search.ix);
+        s->search.built = false;
+        index_destroy(&s->by_tag.ix);
+        s->by_tag.built = false;
+}
+
+/* Mark the task at ROW as done and archive it. Recurring tasks move to
+ * their next occurrence, skipping the missed ones, and the rest are
+ * removed. Returns false if ROW is not a valid row */
+static bool
+store_complete(Store *s, int row)
+{
+        time_t now = time(NULL);
+        const char *error;
+        time_t next;
+        Recur r;
+
+        if (row < 0 || row >= s->size)
+                return false;
+
+        archive_add(s, row, now);
+        if (s->repeat[row] && recur_parse(&r, s->repeat[row], &error) == 0 &&
+            (next = recur_next(&r, s->due[row], s->due[row] > now ? s->due[row] : now)) != -1) {
+                s->due[row] = next;
+                store_remind(s, row);
+                return true;
+        }
+        return store_remove(s, row);
+}
+
+/* Stable LSD radix sort of the N keys in KEYS by date, 8 bits per pass,
+ * using TMP as a buffer of the same size. Only the bytes that change
+ * between the first and last dates are sorted, usually 4 passes. Returns
+ * the buffer that holds the sorted keys. */
+static Occurrence *
+store_radix_sort(Occurrence *keys, Occurrence *tmp, int n)
+{
+        Occurrence *swap;
+        time_t min = keys[0].due;
+        time_t max = keys[0].due;
+        uint64_t range;
+        int count[257];
+
+        for (int i = 1; i < n; i++) {
+                if (keys[i].due < min)
+                        min = keys[i].due;
+                if (keys[i].due > max)
+                        max = keys[i].due;
+        }
+        range = (uint64_t) max - (uint64_t) min;
+
+        for (int shift = 0; shift < 64 && range >> shift; shift += 8) {
+                memset(count, 0, sizeof count);
+                for (int i = 0; i < n; i++)
+                        ++count[(((uint64_t) keys[i].due - min) >> shift & 255) + 1];
+                for (int b = 0; b < 256; b++)
+                        count[b + 1] += count[b];
+                for (int i = 0; i < n; i++)
+                        tmp[count[((uint64_t) keys[i].due - min) >> shift & 255]++] = keys[i];
+                swap = keys;
+                keys = tmp;
+                tmp = swap;
+        }
+        return keys;
+}
+
+/* Sort the rows of DATA by due date. Does nothing if they are sorted.
+ * The occurrence of each row at its due date is sorted, and then every
+ * column is permuted once. */
+static void
+store_sort(Store *s)
+{
+        Occurrence *keys;
+        Occurrence *sorted;
+        void *tmp;
+        int row;
+
+        for (row = 1; row < s->size; row++)
+                if (s->due[row - 1] > s->due[row])
+                        break;
+        if (row >= s->size)
+                return;
+
+        keys = malloc(sizeof *keys * s->size * 2);
+        tmp = malloc(sizeof(time_t) * s->size);
+        assert(keys && tmp);
+        for (row = 0; row < s->size; row++)
+                keys[row] = (Occurrence) { s->due[row], row };
+        sorted = store_radix_sort(keys, keys + s->size, s->size);
+
+        /* Gather each column through TMP, that fits the widest one */
+#define X(col)                                                                 \
+        for (row = 0; row < s->size; row++)                                  \
+                ((__typeof__(s->col)) tmp)[row] = s->col[sorted[row].row]; \
+        memcpy(s->col, tmp, sizeof *s->col * s->size);
+        STORE_COLUMNS(X)
+#undef X
+
+        free(tmp);
+        free(keys);
+}
+
+/* Get every row of DATA */
+static Row_da
+store_rows(Store *s)
+{
+        Row_da rows = { 0 };
+        for (int row = 0; row < s->size; row++)
+                da_append(&rows, row);
+        return rows;
+}
+
 static int
-compare_tasks_by_date(const void *a, const void *b)
+compare_occurrences(const void *a, const void *b)
 {
-        Task *ea = (Task *) a;
-        Task *eb = (Task *) b;
-        return (int) (ea->due - eb->due);
+        const Occurrence *oa = a;
+        const Occurrence *ob = b;
+        if (oa->due != ob->due)
+                return (oa->due > ob->due) - (oa->due < ob->due);
+        return oa->row - ob->row;
+}
+
+/* Get the dates of ROWS, sorted. Recurring tasks also get their next
+ * occurrences up to UNTIL, that are computed here and never stored. */
+static Occurrence_da
+occurrences(Store *s, Row_da rows, time_t until)
+{
+        Occurrence_da occ = { 0 };
+        time_t now = time(NULL);
+        const char *error;
+        Occurrence o;
+        Recur r;
+
+        for_da_each(row, rows)
+        {
+                o = (Occurrence) { s->due[*row], *row };
+                da_append(&occ, o);
+                if (s->repeat[*row] == NULL || recur_parse(&r, s->repeat[*row], &error))
+                        continue;
+                /* Missed occurrences are the pending one */
+                if (o.due < now)
+                        o.due = now;
+                for (int n = 1; n < RECUR_MAX_OCCURRENCES; n++) {
+                        o.due = recur_next(&r, s->due[*row], o.due);
+                        if (o.due == -1 || o.due > until)
+                                break;
+                        da_append(&occ, o);
+                }
+        }
+        qsort(occ.data, occ.size, sizeof *occ.data, compare_occurrences);
+        return occ;
+}
+
+static void
+store_destroy(Store *s)
+{
+        store_clear(s);
+#define X(col) free(s->col);
+        STORE_COLUMNS(X)
+#undef X
+        /* Tasks not archived yet are lost, as the tasks not saved */
+        if (s->archive.stream) {
+                fclose(s->archive.stream);
+                free(s->archive.buf);
+        }
+        memset(s, 0, sizeof *s);
 }
 
 static inline void
-add_if_valid(Task task)
+add_if_valid(Store *s, Task task)
 {
         if (task.name && task.due) {
-                da_append(&data, task);
+                store_add(s, task);
+        }
+}
+
+/* Get the tasks that match every word of QUERY. A word matches the words
+ * of names and descriptions that start with it, or that contain it if it
+ * starts with '*'. */
+static Row_da
+tasks_matching(Store *s, const char *query)
+{
+        Row_da filtered_data = { 0 };
+        unsigned char *matched;
+        int *ids;
+        int n;
+
+        if (!s->search.built) {
+                for (int row = 0; row < s->size; row++) {
+                        index_add(&s->search.ix, s->id[row], s->name[row]);
+                        index_add(&s->search.ix, s->id[row], s->desc[row]);
+                }
+                s->search.built = true;
+        }
+
+        if (index_query(&s->search.ix, query, &ids, &n) == 0) {
+                free(ids);
+                return filtered_data;
+        }
+
+        /* Ids to tasks. DATA order changes when sorted, so tasks are found
+         * with a bitmap of matched ids */
+        matched = calloc(s->next_id / 8 + 1, 1);
+        assert(matched);
+        for (int i = 0; i < n; i++)
+                matched[ids[i] / 8] |= 1 << ids[i] % 8;
+        for (int row = 0; row < s->size; row++) {
+                if (matched[s->id[row] / 8] & 1 << s->id[row] % 8)
+                        da_append(&filtered_data, row);
+        }
+
+        free(matched);
+        free(ids);
+        return filtered_data;
+}
+
+/* Get the tasks that match the query SRC (see query.h). On error, ERROR
+ * is set to a message. */
+static Row_da
+tasks_where(Store *s, const char *src, const char **error)
+{
+        Row_da filtered_data = { 0 };
+        Query_Columns cols = { 0 };
+        uint64_t *matched;
+        int *row_of = NULL;
+        const int *ids;
+        int n;
+        Query q;
+
+        *error = NULL;
+        if (query_compile(&q, src, time(NULL), error))
+                return filtered_data;
+
+        /* Due and prio are already columns of DATA. Tag bitmaps are only
+         * built for the tags the query uses, from their posting lists */
+        matched = calloc(QUERY_WORDS(s->size) + 1, sizeof *matched);
+        cols.tags = calloc(q.tags_size + 1, sizeof *cols.tags);
+        assert(matched && cols.tags);
+        for (int t = 0; t < q.tags_size; t++) {
+                cols.tags[t] = calloc(QUERY_WORDS(s->size) + 1, sizeof **cols.tags);
+                assert(cols.tags[t]);
+        }
+
+        if (q.tags_size && !s->by_tag.built) {
+                for (int row = 0; row < s->size; row++)
+                        store_index_tags(&s->by_tag.ix, s->id[row], s->tags[row], true);
+                s->by_tag.built = true;
+        }
+        /* Ids to rows, as DATA order changes when sorted */
+        if (q.tags_size) {
+                row_of = malloc((s->next_id + 1) * sizeof *row_of);
+                assert(row_of);
+                for (int row = 0; row < s->size; row++)
+                        row_of[s->id[row]] = row;
+        }
+        for (int t = 0; t < q.tags_size; t++) {
+                n = index_key(&s->by_tag.ix, q.tags[t], &ids);
+                for (int i = 0; i < n; i++)
+                        cols.tags[t][row_of[ids[i]] / 64] |= 1ull << row_of[ids[i]] % 64;
+        }
+        cols.size = s->size;
+        cols.due = s->due;
+        cols.prio = s->prio;
+
+        query_eval(&q, &cols, matched);
+
+        for (int row = 0; row < s->size; row++) {
+                if (matched[row / 64] & 1ull << row % 64)
+                        da_append(&filtered_data, row);
         }
+
+        for (int t = 0; t < q.tags_size; t++)
+                free(cols.tags[t]);
+        free(cols.tags);
+        free(row_of);
+        free(matched);
+        query_destroy(&q);
+        return filtered_data;
 }
 
+/* Print the tasks at ROWS of DATA, sorted by date. Recurring tasks are
+ * printed once per occurrence until UNTIL */
 static void
-list_tasks(int fd, Task_da d, const char *format, ...)
+list_tasks(Store *s, int fd, Row_da rows, time_t until, const char *format, ...)
 {
+        Occurrence_da occ = occurrences(s, rows, until);
         va_list arg;
         va_start(arg, format);
-        qsort(d.data, d.size, sizeof *d.data, compare_tasks_by_date);
 
         if (!*quiet) {
                 vdprintf(fd, format, arg);
                 dprintf(fd, ":\n");
         }
-        for_da_each(e, d)
+        for_da_each(o, occ)
         {
-                dprintf(fd, "%d: %s (%s)", da_index(e, d), e->name, overload_date(e->due));
-                dprintf(fd, e->desc ? ": %s\n" : "\n", e->desc);
+                Task e = store_get(s, o->row);
+                dprintf(fd, "%d: %s (%s)", da_index(o, occ), e.name, overload_date(o->due));
+                if (e.repeat)
+                        dprintf(fd, " (repeat: %s)", e.repeat);
+                if (e.tags)
+                        dprintf(fd, " [%s]", e.tags);
+                if (e.prio)
+                        dprintf(fd, " !%d", e.prio);
+                dprintf(fd, e.desc ? ": %s\n" : "\n", e.desc);
         }
-        if (d.size == 0 && !*quiet)
+        va_end(arg);
+        da_destroy(&occ);
+        if (rows.size == 0 && !*quiet)
                 dprintf(fd, "  %s\n", no_tasks_messages[rand() % 10]);
 }
 
+static time_t
+parse_date(const char *str)
+{
+        struct tm tp = { 0 };
+        char *c;
+
+        if ((c = strptime(str, *datetime_format, &tp)) && *c) {
+                LOGW("Can not load %s\n", str);
+        }
+
+        tp.tm_isdst = -1; // determine if summer time is in use (+-1h)
+        return tz_mktime(&tp);
+}
+
+/* Parse a "  field: value" line of a task into TASK. BUF is modified.
+ * Returns false if the field is unknown */
+static bool
+parse_field(Task *task, char *buf)
+{
+        /* DESCRIPTION */
+        if (!memcmp(buf + 2, "desc: ", 6)) {
+                TRUNCAT(buf + 8, '\n');
+                task->desc = strdup(buf + 8);
+        }
+
+        /* TAGS */
+        else if (!memcmp(buf + 2, "tags: ", 6)) {
+                TRUNCAT(buf + 8, '\n');
+                task->tags = strdup(buf + 8);
+        }
+
+        /* PRIORITY */
+        else if (!memcmp(buf + 2, "prio: ", 6)) {
+                task->prio = atoi(buf + 8);
+        }
+
+        /* RECURRENCE RULE */
+        else if (!memcmp(buf + 2, "repeat: ", 8)) {
+                TRUNCAT(buf + 10, '\n');
+                task->repeat = strdup(buf + 10);
+        }
+
+        /* DATE TIME */
+        else if (!memcmp(buf + 2, "date: ", 6)) {
+                TRUNCAT(buf, '\n');
+                task->due = parse_date(buf + 8);
+        }
+
+        else
+                return false;
+        return true;
+}
+
 static int
-load_from_file(const char *filename)
+load_from_file(Store *s, const char *filename)
 {
         FILE *f;
-        char buf[128];
+        char *buf = NULL;
+        size_t cap = 0;
         Task task = { 0 };
-        struct tm tp = { 0 };
-        char *c;
 
         f = fopen(filename, "r");
         if (f == NULL) {
@@ -137,238 +911,2710 @@ load_from_file(const char *filename)
                 return 0;
         }
 
-        while (fgets(buf, sizeof buf - 1, f)) {
+        /* Lines can be as long as imported descriptions */
+        while (getline(&buf, &cap, f) > 0) {
                 switch (buf[0]) {
                         /* NAME */
                 case '[':
-                        add_if_valid(task);
+                        add_if_valid(s, task);
                         ZERO(&task);
                         TRUNCAT(buf, ']');
                         task.name = strdup(buf + 1);
                         break;
 
-                        /* DESCRIPTION */
                 case ' ':
-                        if (!memcmp(buf + 2, "desc: ", 6)) {
-                                TRUNCAT(buf + 8, '\n');
-                                task.desc = strdup(buf + 8);
-                        }
-
-                        /* DATE TIME */
-                        else if (!memcmp(buf + 2, "date: ", 6)) {
-                                TRUNCAT(buf, '\n');
-                                if ((c = strptime(buf + 8, DATETIME_FORMAT, &tp)) && *c) {
-                                        LOG("Can not load %s\n", buf + 8);
-                                }
-
-                                tp.tm_isdst = -1; // determine if summer time is in use (+-1h)
-                                task.due = mktime(&tp);
-                        }
-
-                        /* INVALID ARGUMENT */
-                        else
-                                LOG("Unknown token: %s\n", buf);
+                        if (!parse_field(&task, buf))
+                                LOGW("Unknown token: %s\n", buf);
                         break;
 
                 case '\n':
                         break;
                 default:
-                        LOG("Unknown token: %s\n", buf);
+                        LOGW("Unknown token: %s\n", buf);
                         break;
                 }
         }
 
-        add_if_valid(task);
+        add_if_valid(s, task);
+        free(buf);
         fclose(f);
         return 0;
 }
 
+struct archived {
+        Task task;
+        time_t done;
+};
+
+typedef DA(struct archived) Archived_da;
+
 static int
-load_to_file(const char *filename)
+compare_archived(const void *a, const void *b)
 {
-        FILE *f;
-        f = fopen(filename, "w");
+        const struct archived *ea = a;
+        const struct archived *eb = b;
+        return (ea->done > eb->done) - (ea->done < eb->done);
+}
 
-        if (f == NULL) {
-                LOG("File %s can not be opened to write!\n", filename);
-                return 0;
+static void
+archived_add_if_in(Archived_da *found, struct archived *e, time_t from, time_t to)
+{
+        if (e->task.name && e->done >= from && e->done <= to) {
+                da_append(found, *e);
+        } else {
+                free(e->task.name);
+                free(e->task.desc);
+                free(e->task.tags);
+                free(e->task.repeat);
         }
+        memset(e, 0, sizeof *e);
+}
 
-        for_da_each(task, data)
-        {
-                fprintf(f, "[%s]\n", task->name);
-                fprintf(f, "  date: %s\n", overload_date(task->due));
-                if (task->desc)
-                        fprintf(f, "  desc: %s\n", task->desc);
-                fprintf(f, "\n");
-        }
+/* Read a whole line of GZ into *LINE, as getline(). *LINE grows as needed
+ * and has CAP bytes. Returns the line length or -1 at the end of GZ */
+static ssize_t
+gz_getline(char **line, size_t *cap, gzFile gz)
+{
+        size_t len = 0;
 
-        fclose(f);
-        return data.size;
+        do {
+                if (*cap - len < 128) {
+                        *cap = *cap ? *cap * 2 : 256;
+                        *line = realloc(*line, *cap);
+                        assert(*line);
+                }
+                if (gzgets(gz, *line + len, *cap - len) == NULL)
+                        break;
+                len += strlen(*line + len);
+        } while (len && (*line)[len - 1] != '\n');
+
+        return len ? (ssize_t) len : -1;
 }
 
-static void
-kill_self()
+/* Get the tasks archived in DIR done between FROM and TO, sorted by the
+ * time they were done. Only the partitions of the months in the range are
+ * read. Returns the number of partitions read in *PARTITIONS */
+static Archived_da
+archive_read(const char *dir, time_t from, time_t to, int *partitions)
 {
-        static sem_t *sem = NULL;
-        pid_t pid;
-        int fd;
-
-        if (!sem) {
-                sem = sem_open("/todo_pid_file_sem", O_CREAT, 0600, 1);
-        }
-        assert(sem != SEM_FAILED);
+        Archived_da found = { 0 };
+        struct archived e = { 0 };
+        char path[PATH_MAX];
+        char *buf = NULL;
+        size_t cap = 0;
+        struct tm tm;
+        int first;
+        int last;
+        gzFile gz;
 
-        sem_wait(sem);
+        *partitions = 0;
+        tz_localtime(&from, &tm);
+        first = (tm.tm_year + 1900) * 12 + tm.tm_mon;
+        tz_localtime(&to, &tm);
+        last = (tm.tm_year + 1900) * 12 + tm.tm_mon;
 
-        fd = open(PID_FILENAME, O_RDONLY | O_CREAT, 0600);
-        assert(fd >= 0);
-        while (read(fd, &pid, sizeof pid) == sizeof pid) {
-                kill(pid, SIGTERM);
+        for (int month = first; month <= last; month++) {
+                archive_path(path, sizeof path, dir, month);
+                if ((gz = gzopen(path, "rb")) == NULL)
+                        continue;
+                ++*partitions;
+                /* Lines can be as long as imported descriptions */
+                while (gz_getline(&buf, &cap, gz) > 0) {
+                        if (buf[0] == '[') {
+                                archived_add_if_in(&found, &e, from, to);
+                                TRUNCAT(buf, ']');
+                                e.task.name = strdup(buf + 1);
+                        } else if (buf[0] == ' ' && !memcmp(buf + 2, "done: ", 6)) {
+                                TRUNCAT(buf, '\n');
+                                e.done = parse_date(buf + 8);
+                        } else if (buf[0] == ' ' && !parse_field(&e.task, buf))
+                                LOGW("Unknown token in %s: %s\n", path, buf);
+                }
+                archived_add_if_in(&found, &e, from, to);
+                gzclose(gz);
         }
-        close(fd);
+        free(buf);
 
-        fd = open(PID_FILENAME, O_WRONLY | O_TRUNC | O_CREAT, 0600);
-        assert(fd >= 0);
-        pid = getpid();
-        assert(write(fd, &pid, sizeof pid) == sizeof pid);
-        close(fd);
+        qsort(found.data, found.size, sizeof *found.data, compare_archived);
+        return found;
+}
+
+/* Print the tasks archived in DIR done in the last DAYS days */
+MAIN_ONLY static void
+list_history(int fd, const char *dir, int days)
+{
+        time_t to = time(NULL);
+        time_t from = to - (time_t) days * 24 * 3600;
+        Archived_da found;
+        int partitions;
 
-        sem_post(sem);
+        found = archive_read(dir, from, to, &partitions);
+        if (!*quiet)
+                dprintf(fd, "Tasks done in the last %d days:\n", days);
+        for_da_each(e, found)
+        {
+                dprintf(fd, "%s: ", overload_date(e->done));
+                dprintf(fd, "%s (%s)", e->task.name, overload_date(e->task.due));
+                if (e->task.tags)
+                        dprintf(fd, " [%s]", e->task.tags);
+                dprintf(fd, e->task.desc ? ": %s\n" : "\n", e->task.desc);
+                free(e->task.name);
+                free(e->task.desc);
+                free(e->task.tags);
+                free(e->task.repeat);
+        }
+        if (!*quiet)
+                dprintf(fd, "%d tasks done, %.2f per day (%d partitions read)\n",
+                        found.size, days ? (double) found.size / days : 0.0, partitions);
+        da_destroy(&found);
 }
 
-/* Shared info between serve loop and serve_gen_response thread */
-struct serve_data {
-        struct sockaddr_in sock_in;
-        int clientfd;
-        int addr_len;
+/* Summary of a task file, kept in FILE.summary so a shell prompt can show
+ * it with a single small read. It is valid until the next task is due or
+ * the day ends, and while the file keeps the size and modification time
+ * it had when the summary was written. */
+struct summary {
+        uint32_t magic;
+        int32_t overdue;
+        int32_t today; /* due later today */
+        int64_t next_due; /* -1 if there is none */
+        int64_t day_end; /* last second of the day of the summary */
+        int64_t file_size;
+        int64_t file_mtime_ns;
 };
 
-static void *
-serve_gen_response(void *args)
+#define SUMMARY_MAGIC 0x31444f54 /* "TOD1" */
+
+static void
+summary_path(char *path, size_t size, const char *filename)
 {
-        struct serve_data sdata = *(struct serve_data *) args;
-        char buf[BUFSIZE];
-        char css_file_buf[1024];
-        int clicked_elem_index;
-        int fd;
-        int n;
+        snprintf(path, size, "%s.summary", filename);
+}
 
-        if (sdata.clientfd < 0) {
-                LOG("invalid clientfd\n");
-                return NULL;
-        }
+/* Count the task due at DUE, or its occurrences if REPEAT is not NULL, as
+ * occurrences() does */
+static void
+summary_add(struct summary *sum, time_t due, const char *repeat, time_t now)
+{
+        const char *error;
+        bool recurring;
+        time_t next;
+        Recur r;
+
+        recurring = repeat && recur_parse(&r, repeat, &error) == 0;
+        next = due;
+        if (next <= now) {
+                ++sum->overdue;
+                /* Missed occurrences are the pending one */
+                next = recurring ? recur_next(&r, due, now) : -1;
+        }
+        if (next == -1)
+                return;
+        if (sum->next_due == -1 || next < sum->next_due)
+                sum->next_due = next;
+        for (int n = 0; next != -1 && next <= sum->day_end && n < RECUR_MAX_OCCURRENCES; n++) {
+                ++sum->today;
+                if (!recurring)
+                        break;
+                next = recur_next(&r, due, next);
+        }
+}
+
+static void
+summary_count(Store *s, time_t now, struct summary *sum)
+{
+        struct tm tm;
+
+        tz_localtime(&now, &tm);
+        tm.tm_hour = 23;
+        tm.tm_min = 59;
+        tm.tm_sec = 59;
+        tm.tm_isdst = -1; // determine if summer time is in use (+-1h)
+        *sum = (struct summary) {
+                .magic = SUMMARY_MAGIC,
+                .next_due = -1,
+                .day_end = tz_mktime(&tm),
+        };
+        for (int row = 0; row < s->size; row++)
+                summary_add(sum, s->due[row], s->repeat[row], now);
+}
+
+/* Save SUM as the summary of FILENAME, that has to be already written */
+static void
+summary_save(struct summary *sum, const char *filename)
+{
+        char path[PATH_MAX];
+        char tmp[PATH_MAX + 16];
+        struct stat st;
+        int fd;
+
+        if (stat(filename, &st) < 0)
+                return;
+        sum->file_size = st.st_size;
+        sum->file_mtime_ns = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+
+        /* Readers see the old summary or the new one, never a part */
+        summary_path(path, sizeof path, filename);
+        snprintf(tmp, sizeof tmp, "%s.%d", path, getpid());
+        if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+                LOGE("Can not write summary %s: %s\n", tmp, strerror(errno));
+                return;
+        }
+        if (write(fd, sum, sizeof *sum) != sizeof *sum || rename(tmp, path) < 0) {
+                LOGE("Can not write summary %s: %s\n", path, strerror(errno));
+                unlink(tmp);
+        }
+        close(fd);
+}
+
+/* Read the summary of FILENAME into SUM. Returns false if there is none
+ * or it is stale at NOW */
+MAIN_ONLY static bool
+summary_read(struct summary *sum, const char *filename, time_t now)
+{
+        char path[PATH_MAX];
+        struct stat st;
+        ssize_t n;
+        int fd;
+
+        summary_path(path, sizeof path, filename);
+        if ((fd = open(path, O_RDONLY)) < 0)
+                return false;
+        n = read(fd, sum, sizeof *sum);
+        close(fd);
+
+        return n == sizeof *sum && sum->magic == SUMMARY_MAGIC &&
+               now <= sum->day_end && (sum->next_due == -1 || now < sum->next_due) &&
+               stat(filename, &st) == 0 && st.st_size == sum->file_size &&
+               st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec == sum->file_mtime_ns;
+}
+
+/* Write the summary of the tasks of S, saved in FILENAME. Every change to
+ * a store that is saved to a file has to call it */
+static void
+summary_update(Store *s, const char *filename)
+{
+        struct summary sum;
+        summary_count(s, time(NULL), &sum);
+        summary_save(&sum, filename);
+}
+
+static int
+load_to_file(Store *s, const char *filename)
+{
+        uint64_t start = metrics_now_ns();
+        FILE *f;
+
+        /* Tasks are removed from the hot file only after they are archived */
+        archive_flush(s);
+
+        f = fopen(filename, "w");
+
+        if (f == NULL) {
+                LOGE("File %s can not be opened to write!\n", filename);
+                return 0;
+        }
+
+        for (int row = 0; row < s->size; row++) {
+                write_task(s, f, row);
+                fprintf(f, "\n");
+        }
+
+        fclose(f);
+        summary_update(s, filename);
+        hist_record(&m_save, metrics_now_ns() - start);
+        return s->size;
+}
+
+/* Formats of -import and -export, see formats.h */
+enum task_format {
+        FORMAT_CSV = 0,
+        FORMAT_NDJSON,
+        FORMAT_ICS,
+        FORMAT_COUNT,
+};
+
+static const char *task_format_names[FORMAT_COUNT] = {
+        [FORMAT_CSV] = "csv",
+        [FORMAT_NDJSON] = "ndjson",
+        [FORMAT_ICS] = "ics",
+};
+
+/* CSV columns, in the order they are exported */
+static const char *csv_columns[] = { "name", "due", "desc", "tags", "prio", "repeat" };
+
+/* Get the format NAME, or the format of the extension of FILENAME if NAME
+ * is NULL. Files without a known extension are CSV. Returns -1 if NAME is
+ * not a format */
+MAIN_ONLY static int
+task_format(const char *name, const char *filename)
+{
+        const char *ext = strrchr(filename, '.');
+
+        if (name == NULL) {
+                if (ext && (!strcmp(ext, ".ndjson") || !strcmp(ext, ".jsonl")))
+                        return FORMAT_NDJSON;
+                if (ext && !strcmp(ext, ".ics"))
+                        return FORMAT_ICS;
+                return FORMAT_CSV;
+        }
+        for (int i = 0; i < FORMAT_COUNT; i++)
+                if (!strcmp(name, task_format_names[i]))
+                        return i;
+        return -1;
+}
+
+/* Parse an ISO 8601 date, as YYYY-MM-DD[THH:MM[:SS]] or YYYYMMDD[THHMMSS],
+ * optionally followed by Z or an offset as +HH:MM, or seconds since the
+ * epoch. Dates without zone are local, and dates without time are due at
+ * 23:59:59, as the ones of -add. Returns -1 on error */
+static time_t
+parse_iso_date(const char *str)
+{
+        struct tm tm = { 0 };
+        const char *c = str + strspn(str, " \t");
+        int n = 0;
+        int oh = 0;
+        int om = 0;
+        char *end;
+        long long epoch;
+
+        n = strspn(c, "0123456789");
+        if (n != 8 && c[n] != '-') {
+                epoch = strtoll(c, &end, 10);
+                return end == c || end[strspn(end, " \t")] ? -1 : (time_t) epoch;
+        }
+
+        if (sscanf(c, "%4d-%2d-%2d%n", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &n) != 3 &&
+            sscanf(c, "%4d%2d%2d%n", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &n) != 3)
+                return -1;
+        c += n;
+        tm.tm_year -= 1900;
+        --tm.tm_mon;
+        tm.tm_hour = 23;
+        tm.tm_min = 59;
+        tm.tm_sec = 59;
+
+        if (*c == 'T' || *c == ' ') {
+                tm.tm_sec = 0;
+                n = 0;
+                if (sscanf(c + 1, "%2d:%2d%n:%2d%n", &tm.tm_hour, &tm.tm_min, &n, &tm.tm_sec, &n) >= 2 ||
+                    sscanf(c + 1, "%2d%2d%n%2d%n", &tm.tm_hour, &tm.tm_min, &n, &tm.tm_sec, &n) >= 2)
+                        c += 1 + n;
+                else if (*c == 'T')
+                        return -1;
+        }
+
+        if (tm.tm_mon < 0 || tm.tm_mon > 11 || tm.tm_mday < 1 || tm.tm_mday > 31 ||
+            tm.tm_hour > 23 || tm.tm_min > 59 || tm.tm_sec > 60)
+                return -1;
+
+        if (*c == 'Z')
+                return c[1 + strspn(c + 1, " \t")] ? -1 : tz_timegm(&tm);
+        if ((*c == '+' || *c == '-') &&
+            (sscanf(c + 1, "%2d:%2d%n", &oh, &om, &n) == 2 || sscanf(c + 1, "%2d%2d%n", &oh, &om, &n) == 2)) {
+                if (c[1 + n + strspn(c + 1 + n, " \t")])
+                        return -1;
+                return tz_timegm(&tm) - (*c == '-' ? -1 : 1) * (oh * 3600 + om * 60);
+        }
+        if (c[strspn(c, " \t")])
+                return -1;
+        tm.tm_isdst = -1; // determine if summer time is in use (+-1h)
+        return tz_mktime(&tm);
+}
+
+/* The todo.out format has a field per line */
+static char *
+strdup_line(const char *str)
+{
+        char *dup = str && *str ? strdup(str) : NULL;
+        for (char *c = dup; c && *c; c++)
+                if (*c == '\n' || *c == '\r')
+                        *c = ' ';
+        return dup;
+}
+
+/* Set the field KEY of TASK to VALUE. Unknown fields are ignored.
+ * Returns false and an error message in *ERROR if VALUE is not valid */
+static bool
+import_field(Task *task, const char *key, const char *value, const char **error)
+{
+        char *end;
+
+        if (value && *value == 0)
+                value = NULL;
+        if (!strcmp(key, "name")) {
+                free(task->name);
+                task->name = strdup_line(value);
+        } else if (!strcmp(key, "due")) {
+                if (value == NULL || (task->due = parse_iso_date(value)) == -1) {
+                        *error = "invalid due date";
+                        return false;
+                }
+        } else if (!strcmp(key, "desc")) {
+                free(task->desc);
+                task->desc = strdup_line(value);
+        } else if (!strcmp(key, "tags")) {
+                free(task->tags);
+                task->tags = strdup_line(value);
+        } else if (!strcmp(key, "prio")) {
+                task->prio = value ? strtol(value, &end, 10) : 0;
+                if (value && (end == value || *end)) {
+                        *error = "invalid prio";
+                        return false;
+                }
+        } else if (!strcmp(key, "repeat")) {
+                free(task->repeat);
+                task->repeat = strdup_line(value);
+        }
+        return true;
+}
+
+/* Add TASK to S if it is valid. Returns false and an error message in
+ * *ERROR otherwise */
+static bool
+import_task(Store *s, Task task, const char **error)
+{
+        Recur r;
+
+        if (*error == NULL && task.name == NULL)
+                *error = "missing name";
+        else if (*error == NULL && task.due <= 0)
+                *error = "missing due date";
+        else if (*error == NULL && task.repeat)
+                recur_parse(&r, task.repeat, error);
+
+        if (*error) {
+                free(task.name);
+                free(task.desc);
+                free(task.tags);
+                free(task.repeat);
+                return false;
+        }
+        store_add(s, task);
+        return true;
+}
+
+/* Convert the iCalendar RRULE to a rule of recur.h, in BUF. Only FREQ,
+ * INTERVAL and BYMONTHDAY can be converted. Returns false otherwise */
+static bool
+rrule_to_repeat(char *rrule, char *buf, size_t size)
+{
+        const char *unit = NULL;
+        char *saveptr;
+        int interval = 1;
+        int mday = 0;
+
+        for (char *part = strtok_r(rrule, ";", &saveptr); part; part = strtok_r(NULL, ";", &saveptr)) {
+                if (!strcmp(part, "FREQ=DAILY"))
+                        unit = "days";
+                else if (!strcmp(part, "FREQ=WEEKLY"))
+                        unit = "weeks";
+                else if (!strcmp(part, "FREQ=MONTHLY"))
+                        unit = "months";
+                else if (sscanf(part, "INTERVAL=%d", &interval) == 1 && interval > 0)
+                        ;
+                else if (sscanf(part, "BYMONTHDAY=%d", &mday) == 1 && mday > 0 && mday <= 31)
+                        ;
+                else if (strncmp(part, "WKST=", 5) != 0)
+                        return false;
+        }
+        if (unit == NULL || (mday && strcmp(unit, "months")))
+                return false;
+        if (interval == 1)
+                snprintf(buf, size, "%s", unit[0] == 'd' ? "daily" : unit[0] == 'w' ? "weekly" : "monthly");
+        else
+                snprintf(buf, size, "every %d %s", interval, unit);
+        if (mday)
+                strcatf(buf, " on %d", mday);
+        return true;
+}
+
+/* Read the VTODO and VEVENT components of an iCalendar file. DUE, or
+ * DTSTART if there is no DUE, is the due date */
+static void
+import_ics(Store *s, Format_Reader *r, const char *filename, int *imported, int *rejected)
+{
+        const char *error = NULL;
+        char repeat[64];
+        char *name;
+        char *params;
+        char *value;
+        Task task = { 0 };
+        /* 1 inside a task, more inside its components, as VALARM */
+        int depth = 0;
+        bool has_due = false;
+        long lineno = 0;
+        int prio;
+
+        while (ics_read(r, &name, &params, &value)) {
+                bool task_component = !strcasecmp(value, "VTODO") || !strcasecmp(value, "VEVENT");
+
+                if (!strcasecmp(name, "BEGIN") && depth == 0 && task_component) {
+                        task = (Task) { 0 };
+                        error = NULL;
+                        depth = 1;
+                        has_due = false;
+                        lineno = r->lineno;
+                } else if (depth == 0)
+                        continue;
+                else if (!strcasecmp(name, "BEGIN"))
+                        ++depth;
+                else if (!strcasecmp(name, "END") && depth > 1)
+                        --depth;
+                else if (depth > 1)
+                        /* Properties of an alarm are not the task's */
+                        continue;
+                else if (!strcasecmp(name, "END")) {
+                        if (!task_component)
+                                continue;
+                        if (import_task(s, task, &error))
+                                ++*imported;
+                        else {
+                                fprintf(stderr, "ERROR: %s:%ld: %s\n", filename, lineno, error);
+                                ++*rejected;
+                        }
+                        depth = 0;
+                } else if (!strcasecmp(name, "SUMMARY")) {
+                        free(task.name);
+                        task.name = strdup_line(ics_unescape(value));
+                } else if (!strcasecmp(name, "DESCRIPTION")) {
+                        free(task.desc);
+                        task.desc = strdup_line(ics_unescape(value));
+                } else if (!strcasecmp(name, "CATEGORIES")) {
+                        free(task.tags);
+                        task.tags = strdup_line(ics_unescape(value));
+                } else if (!strcasecmp(name, "PRIORITY")) {
+                        /* 1 is the highest priority and 0 is undefined */
+                        prio = atoi(value);
+                        task.prio = prio > 0 && prio <= 9 ? 10 - prio : 0;
+                } else if (!strcasecmp(name, "DUE") || (!strcasecmp(name, "DTSTART") && !has_due)) {
+                        /* TZID is ignored, times are local */
+                        if ((task.due = parse_iso_date(value)) == -1 && error == NULL)
+                                error = "invalid due date";
+                        has_due |= !strcasecmp(name, "DUE");
+                } else if (!strcasecmp(name, "RRULE")) {
+                        free(task.repeat);
+                        task.repeat = NULL;
+                        if (rrule_to_repeat(value, repeat, sizeof repeat))
+                                task.repeat = strdup(repeat);
+                        else if (error == NULL)
+                                error = "unsupported RRULE";
+                } else if (!strcasecmp(name, "X-TODO-REPEAT")) {
+                        free(task.repeat);
+                        task.repeat = strdup_line(value);
+                }
+        }
+        if (depth) {
+                fprintf(stderr, "ERROR: %s:%ld: %s\n", filename, lineno, "missing END");
+                free(task.name);
+                free(task.desc);
+                free(task.tags);
+                free(task.repeat);
+                ++*rejected;
+        }
+}
+
+/* Add the tasks of FILENAME, "-" for stdin, to S. Records are read and
+ * added one by one, and invalid ones are reported and skipped. Tasks are
+ * saved once, with the rest of the changes. Returns the number of tasks
+ * added or -1 if the file can not be read */
+MAIN_ONLY static int
+import_tasks(Store *s, const char *filename, enum task_format format)
+{
+        Format_Reader r = { 0 };
+        Format_Field fields[16];
+        char *csv[16];
+        /* Column of each field of csv_columns, in the order of the header */
+        int columns[16];
+        int ncolumns = 0;
+        const char *error;
+        int imported = 0;
+        int rejected = 0;
+        Task task;
+        int n;
+
+        r.f = strcmp(filename, "-") ? fopen(filename, "r") : stdin;
+        if (r.f == NULL) {
+                fprintf(stderr, "ERROR: can not open %s: %s\n", filename, strerror(errno));
+                return -1;
+        }
+
+        switch (format) {
+        case FORMAT_CSV:
+                while ((n = csv_read(&r, csv, 16)) >= 0) {
+                        if (n == 1 && csv[0][0] == 0)
+                                continue;
+                        /* The header is optional */
+                        if (ncolumns == 0) {
+                                for (int i = 0; i < 16; i++)
+                                        columns[i] = i < 6 ? i : -1;
+                                ncolumns = 6;
+                                if (!strcasecmp(csv[0], "name") || !strcasecmp(csv[0], "due")) {
+                                        for (int i = 0; i < n; i++) {
+                                                columns[i] = -1;
+                                                for (int j = 0; j < 6; j++)
+                                                        if (!strcasecmp(csv[i], csv_columns[j]))
+                                                                columns[i] = j;
+                                        }
+                                        ncolumns = n;
+                                        continue;
+                                }
+                        }
+                        task = (Task) { 0 };
+                        error = NULL;
+                        for (int i = 0; i < n && i < ncolumns && error == NULL; i++)
+                                if (columns[i] >= 0)
+                                        import_field(&task, csv_columns[columns[i]], csv[i], &error);
+                        if (import_task(s, task, &error))
+                                ++imported;
+                        else {
+                                fprintf(stderr, "ERROR: %s:%ld: %s\n", filename, r.lineno, error);
+                                ++rejected;
+                        }
+                }
+                break;
+
+        case FORMAT_NDJSON:
+                while ((n = ndjson_read(&r, fields, 16, &error)) >= 0) {
+                        if (n == 0 && error == NULL)
+                                continue;
+                        task = (Task) { 0 };
+                        for (int i = 0; i < n && error == NULL; i++)
+                                import_field(&task, fields[i].key, fields[i].value, &error);
+                        if (import_task(s, task, &error))
+                                ++imported;
+                        else {
+                                fprintf(stderr, "ERROR: %s:%ld: %s\n", filename, r.lineno, error);
+                                ++rejected;
+                        }
+                }
+                break;
+
+        case FORMAT_ICS:
+                import_ics(s, &r, filename, &imported, &rejected);
+                break;
 
-        switch (read(sdata.clientfd, buf, sizeof buf - 1)) {
         default:
-                if (sscanf(buf, "GET /?button=%d HTTP/1.1", &clicked_elem_index) == 1) {
-                        switch (clicked_elem_index) {
-                        default:
-                                /* Buttons from 0 to tasks num - 1 */
-                                da_remove(&data, clicked_elem_index);
-                                break;
-                        case -1:
-                                /* Save button */
-                                load_to_file(*out_file);
+                UNREACHABLE("task format");
+        }
+
+        if (r.f != stdin)
+                fclose(r.f);
+        format_reader_destroy(&r);
+        if (!*quiet)
+                printf("Imported %d tasks, %d rejected\n", imported, rejected);
+        return imported;
+}
+
+/* Write every task of S to FILENAME, "-" for stdout, sorted by date */
+MAIN_ONLY static int
+export_tasks(Store *s, const char *filename, enum task_format format)
+{
+        char buf[64];
+        char uid[64];
+        time_t now = time(NULL);
+        const char *error;
+        struct tm tm;
+        FILE *f;
+        Recur r;
+
+        f = strcmp(filename, "-") ? fopen(filename, "w") : stdout;
+        if (f == NULL) {
+                fprintf(stderr, "ERROR: can not open %s: %s\n", filename, strerror(errno));
+                return -1;
+        }
+
+        store_sort(s);
+        switch (format) {
+        case FORMAT_CSV:
+                for (int i = 0; i < 6; i++)
+                        csv_write(f, csv_columns[i], i == 5);
+                for (int row = 0; row < s->size; row++) {
+                        strftime(buf, sizeof buf, "%Y-%m-%dT%H:%M:%S", tz_localtime(&s->due[row], &tm));
+                        csv_write(f, s->name[row], false);
+                        csv_write(f, buf, false);
+                        csv_write(f, s->desc[row], false);
+                        csv_write(f, s->tags[row], false);
+                        snprintf(buf, sizeof buf, "%d", s->prio[row]);
+                        csv_write(f, buf, false);
+                        csv_write(f, s->repeat[row], true);
+                }
+                break;
+
+        case FORMAT_NDJSON:
+                for (int row = 0; row < s->size; row++) {
+                        write_task_json(s, f, row);
+                        fputc('\n', f);
+                }
+                break;
+
+        case FORMAT_ICS:
+                fputs("BEGIN:VCALENDAR\r\nVERSION:2.0\r\nPRODID:-//todo//todo//EN\r\n", f);
+                for (int row = 0; row < s->size; row++) {
+                        fputs("BEGIN:VTODO\r\n", f);
+                        snprintf(uid, sizeof uid, "%016llx-%lld@todo",
+                                 (unsigned long long) index_hash(s->name[row]), (long long) s->due[row]);
+                        ics_write(f, "UID", uid, false);
+                        strftime(buf, sizeof buf, "%Y%m%dT%H%M%SZ", gmtime(&now));
+                        ics_write(f, "DTSTAMP", buf, false);
+                        ics_write(f, "SUMMARY", s->name[row], true);
+                        strftime(buf, sizeof buf, "%Y%m%dT%H%M%S", tz_localtime(&s->due[row], &tm));
+                        ics_write(f, "DUE", buf, false);
+                        if (s->desc[row])
+                                ics_write(f, "DESCRIPTION", s->desc[row], true);
+                        /* Tags are already a comma separated list */
+                        if (s->tags[row])
+                                ics_write(f, "CATEGORIES", s->tags[row], false);
+                        if (s->prio[row] > 0) {
+                                snprintf(buf, sizeof buf, "%d", s->prio[row] < 9 ? 10 - s->prio[row] : 1);
+                                ics_write(f, "PRIORITY", buf, false);
+                        }
+                        if (s->repeat[row] && !recur_parse(&r, s->repeat[row], &error)) {
+                                if (r.kind == RECUR_CRON)
+                                        ics_write(f, "X-TODO-REPEAT", s->repeat[row], false);
+                                else {
+                                        snprintf(buf, sizeof buf, "FREQ=%s;INTERVAL=%d",
+                                                 r.kind == RECUR_DAYS  ? "DAILY" :
+                                                 r.kind == RECUR_WEEKS ? "WEEKLY" :
+                                                                         "MONTHLY",
+                                                 r.every);
+                                        if (r.mday)
+                                                strcatf(buf, ";BYMONTHDAY=%d", r.mday);
+                                        ics_write(f, "RRULE", buf, false);
+                                }
+                        }
+                        fputs("END:VTODO\r\n", f);
+                }
+                fputs("END:VCALENDAR\r\n", f);
+                break;
+
+        default:
+                UNREACHABLE("task format");
+        }
+
+        if (f == stdout)
+                fflush(f);
+        else
+                fclose(f);
+        return s->size;
+}
+
+/* Take the lock of -pid_file, that the daemon holds while it runs, and
+ * write its pid in it. The lock is released by the kernel when the
+ * process ends, however it ends. If WAIT it waits for the daemon that
+ * holds it. Returns false if there is another daemon */
+static bool
+daemon_lock(bool wait)
+{
+        static int fd = -1;
+
+        if (fd < 0 && (fd = open(*pid_file, O_RDWR | O_CREAT | O_CLOEXEC, 0600)) < 0) {
+                perror(*pid_file);
+                exit(1);
+        }
+        while (flock(fd, LOCK_EX | (wait ? 0 : LOCK_NB)) < 0) {
+                if (errno == EWOULDBLOCK)
+                        return false;
+                if (errno != EINTR) {
+                        perror(*pid_file);
+                        exit(1);
+                }
+        }
+        if (ftruncate(fd, 0) < 0 || dprintf(fd, "%d\n", getpid()) < 0)
+                perror(*pid_file);
+        return true;
+}
+
+/* Shared info between serve loop and serve_gen_response thread */
+struct serve_data {
+        struct sockaddr_in sock_in;
+        int clientfd;
+        int addr_len;
+        uint64_t accepted_ns;
+};
+
+enum page_encoding {
+        ENC_IDENTITY = 0,
+        ENC_GZIP,
+        ENC_DEFLATE,
+        ENC_COUNT,
+};
+
+static const char *page_encoding_names[ENC_COUNT] = {
+        [ENC_IDENTITY] = NULL,
+        [ENC_GZIP] = "gzip",
+        [ENC_DEFLATE] = "deflate",
+};
+
+/* Rendered html page. Compressed variants are generated the first time a
+ * client asks for them and live as long as the page. It is shared between
+ * threads, so it is freed when the last reference is released. */
+struct page {
+        int refs;
+        char *body[ENC_COUNT];
+        size_t len[ENC_COUNT];
+};
+
+/* Last page rendered of a list */
+struct page_cache {
+        pthread_mutex_t lock;
+        struct page *page;
+        unsigned long gen;
+        struct timespec css_mtime; /* the page links the css of this time */
+        time_t hour; /* occurrences of recurring tasks depend on the time */
+};
+
+/* A task list served by the daemon. The default list is the one of
+ * -in_file and -out_file and the named ones are NAME.out files in
+ * -lists_dir, served at /list/NAME. Each list has its own lock, so
+ * requests to different lists do not wait for each other. */
+typedef struct {
+        char name[LIST_NAME_MAX + 1]; /* empty for the default list */
+        char *in_file;
+        char *out_file;
+        char *archive_dir;
+        /* Every access to DATA has to be done holding LOCK, and every
+         * change has to increment GEN, so the page is rendered again */
+        pthread_mutex_t lock;
+        Store data;
+        unsigned long gen;
+        unsigned long saved_gen; /* GEN of the last save */
+        bool loaded;
+        struct page_cache cache;
+        /* Protected by lists.lock */
+        int refs;
+        uint64_t used; /* value of lists.clock in the last list_get() */
+} Todo_List;
+
+typedef DA(Todo_List *) Todo_List_da;
+
+/* Lists known by the daemon. Lists are loaded the first time they are
+ * requested, and the least recently used ones are saved and unloaded when
+ * there are more than *MAX_LISTS */
+static struct {
+        pthread_mutex_t lock;
+        Todo_List_da all;
+        /* Lists removed from ALL that are being saved without LOCK, see
+         * lists_unload(). UNLOADED is signaled when they are saved */
+        Todo_List_da unloading;
+        pthread_cond_t unloaded;
+        uint64_t clock;
+} lists = { .lock = PTHREAD_MUTEX_INITIALIZER, .unloaded = PTHREAD_COND_INITIALIZER };
+
+static void
+page_release(struct page *page)
+{
+        if (__atomic_sub_fetch(&page->refs, 1, __ATOMIC_ACQ_REL) > 0)
+                return;
+        for (int i = 0; i < ENC_COUNT; i++)
+                free(page->body[i]);
+        free(page);
+}
+
+/* List names are used as file names, so only [A-Za-z0-9_-] is allowed */
+static bool
+list_name_valid(const char *name)
+{
+        size_t n = strspn(name, "abcdefghijklmnopqrstuvwxyz"
+                                "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                "0123456789_-");
+        return n > 0 && n <= LIST_NAME_MAX && name[n] == 0;
+}
+
+/* Save the tasks of L if they changed since they were saved */
+static void
+list_save(Todo_List *l)
+{
+        if (l->loaded && l->gen != l->saved_gen) {
+                load_to_file(&l->data, l->out_file);
+                l->saved_gen = l->gen;
+        }
+}
+
+static void
+list_destroy(Todo_List *l)
+{
+        list_save(l);
+        store_destroy(&l->data);
+        if (l->cache.page)
+                page_release(l->cache.page);
+        pthread_mutex_destroy(&l->cache.lock);
+        pthread_mutex_destroy(&l->lock);
+        free(l->in_file);
+        free(l->out_file);
+        free(l->archive_dir);
+        free(l);
+}
+
+/* Remove the least recently used lists that are not in use until there
+ * are at most *MAX_LISTS, and move them to LISTS.UNLOADING. The default
+ * list is never unloaded. LISTS.LOCK must be held. Returns the removed
+ * lists, that have to be unloaded with lists_unload() after LISTS.LOCK is
+ * released */
+static Todo_List_da
+lists_evict()
+{
+        Todo_List_da evicted = { 0 };
+        Todo_List **lru;
+
+        while (lists.all.size > *max_lists) {
+                lru = NULL;
+                for_da_each(l, lists.all)
+                {
+                        if ((*l)->refs == 0 && (*l)->name[0] &&
+                            (lru == NULL || (*l)->used < (*lru)->used))
+                                lru = l;
+                }
+                if (lru == NULL)
+                        break;
+                LOGI("Unload list %s\n", (*lru)->name);
+                da_append(&evicted, *lru);
+                da_append(&lists.unloading, *lru);
+                *lru = lists.all.data[--lists.all.size];
+        }
+        return evicted;
+}
+
+/* Save and destroy the lists EVICTED by lists_evict(). Saving takes as
+ * long as writing the file, so it is done without LISTS.LOCK and only
+ * requests to these lists wait for it, in list_get() */
+static void
+lists_unload(Todo_List_da *evicted)
+{
+        if (evicted->size == 0)
+                return;
+        /* Nobody holds a reference, so nobody holds their locks */
+        for_da_each(l, *evicted)
+                list_save(*l);
+
+        pthread_mutex_lock(&lists.lock);
+        for_da_each(l, *evicted)
+        {
+                for (int i = 0; i < lists.unloading.size; i++) {
+                        if (lists.unloading.data[i] == *l) {
+                                lists.unloading.data[i] = lists.unloading.data[--lists.unloading.size];
                                 break;
                         }
+                }
+        }
+        pthread_cond_broadcast(&lists.unloaded);
+        pthread_mutex_unlock(&lists.lock);
+
+        for_da_each(l, *evicted)
+                list_destroy(*l);
+        da_destroy(evicted);
+}
+
+/* Check if the list NAME is being unloaded. LISTS.LOCK must be held */
+static bool
+list_unloading(const char *name)
+{
+        for_da_each(l, lists.unloading)
+        {
+                if (strcmp((*l)->name, name) == 0)
+                        return true;
+        }
+        return false;
+}
+
+/* Get a reference to the list NAME, or to the default list if NAME is
+ * empty. It has to be released with list_put(). Tasks are loaded by
+ * list_lock(), and not here, so loading a list does not block requests
+ * to the other ones. */
+static Todo_List *
+list_get(const char *name)
+{
+        char path[PATH_MAX];
+        Todo_List *list = NULL;
+        Todo_List_da evicted;
+
+        pthread_mutex_lock(&lists.lock);
+        /* Its file would be loaded before it is saved */
+        while (list_unloading(name))
+                pthread_cond_wait(&lists.unloaded, &lists.lock);
+        for_da_each(l, lists.all)
+        {
+                if (strcmp((*l)->name, name) == 0) {
+                        list = *l;
                         break;
                 }
-                if (strncmp(buf, "GET /favicon.ico HTTP/1.1", 25) == 0) {
-                        /* The client ask for the icon. As it is not needed,
-                         * return and dont send anything to the client. */
+        }
+
+        if (list == NULL) {
+                list = calloc(1, sizeof *list);
+                assert(list);
+                strcpy(list->name, name);
+                if (*name) {
+                        mkdir(*lists_dir, 0755);
+                        snprintf(path, sizeof path, "%s/%s.out", *lists_dir, name);
+                        list->in_file = strdup(path);
+                        list->out_file = strdup(path);
+                        snprintf(path, sizeof path, "%s/%s.archive", *lists_dir, name);
+                        list->archive_dir = strdup(path);
+                } else {
+                        list->in_file = strdup(*in_file);
+                        list->out_file = strdup(*out_file);
+                        list->archive_dir = *archive_dir ? strdup(*archive_dir) : NULL;
+                }
+                pthread_mutex_init(&list->lock, NULL);
+                pthread_mutex_init(&list->cache.lock, NULL);
+                da_append(&lists.all, list);
+        }
+
+        ++list->refs;
+        list->used = ++lists.clock;
+        evicted = lists_evict();
+        pthread_mutex_unlock(&lists.lock);
+        lists_unload(&evicted);
+        return list;
+}
+
+static void
+list_put(Todo_List *l)
+{
+        Todo_List_da evicted;
+
+        pthread_mutex_lock(&lists.lock);
+        --l->refs;
+        evicted = lists_evict();
+        pthread_mutex_unlock(&lists.lock);
+        lists_unload(&evicted);
+}
+
+/* Lock the list L, loading its tasks if they are not loaded yet */
+static void
+list_lock(Todo_List *l)
+{
+        pthread_mutex_lock(&l->lock);
+        if (!l->loaded) {
+                l->data.archive.dir = l->archive_dir;
+                l->data.remind = reminders.running ? l->name : NULL;
+                load_from_file(&l->data, l->in_file);
+                l->loaded = true;
+        }
+}
+
+static void
+list_unlock(Todo_List *l)
+{
+        pthread_mutex_unlock(&l->lock);
+}
+
+/* Move the tasks of S to the default list, that is served with them
+ * instead of loading them again from -in_file */
+static void
+lists_adopt(Store *s)
+{
+        Todo_List *l = list_get("");
+        pthread_mutex_lock(&l->lock);
+        store_destroy(&l->data);
+        l->data = *s;
+        l->data.archive.dir = l->archive_dir;
+        if (reminders.running) {
+                l->data.remind = l->name;
+                for (int row = 0; row < l->data.size; row++)
+                        store_remind(&l->data, row);
+        }
+        memset(s, 0, sizeof *s);
+        l->loaded = true;
+        ++l->gen;
+        l->saved_gen = l->gen;
+        pthread_mutex_unlock(&l->lock);
+        list_put(l);
+}
+
+/* Save the lists that changed since they were saved */
+static void
+lists_flush()
+{
+        pthread_mutex_lock(&lists.lock);
+        for_da_each(l, lists.all)
+        {
+                pthread_mutex_lock(&(*l)->lock);
+                list_save(*l);
+                pthread_mutex_unlock(&(*l)->lock);
+        }
+        pthread_mutex_unlock(&lists.lock);
+}
+
+static void
+lists_destroy()
+{
+        pthread_mutex_lock(&lists.lock);
+        for_da_each(l, lists.all)
+                list_destroy(*l);
+        da_destroy(&lists.all);
+        pthread_mutex_unlock(&lists.lock);
+}
+
+/* Compress SRC using gzip or zlib (deflate) format. Returns a malloced
+ * buffer or NULL on error. */
+static char *
+compress_buf(const char *src, size_t len, enum page_encoding enc, size_t *out_len)
+{
+        z_stream zs = { 0 };
+        char *out;
+        int bits;
+
+        bits = enc == ENC_GZIP ? 15 + 16 : 15;
+        if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, bits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+                return NULL;
+
+        out = malloc(deflateBound(&zs, len));
+        if (out == NULL) {
+                deflateEnd(&zs);
+                return NULL;
+        }
+
+        zs.next_in = (Bytef *) src;
+        zs.avail_in = len;
+        zs.next_out = (Bytef *) out;
+        zs.avail_out = deflateBound(&zs, len);
+
+        if (deflate(&zs, Z_FINISH) != Z_STREAM_END) {
+                deflateEnd(&zs);
+                free(out);
+                return NULL;
+        }
+
+        *out_len = zs.total_out;
+        deflateEnd(&zs);
+        return out;
+}
+
+/* Get the value of the header NAME in the response head RES, or NULL if
+ * it is not present. The value ends at the next "\r\n". Requests are
+ * parsed with http.h */
+static const char *
+find_header(const char *res, const char *name)
+{
+        size_t n = strlen(name);
+        const char *line;
+
+        for (line = res; (line = strstr(line, "\r\n")); line += 2)
+                if (strncasecmp(line + 2, name, n) == 0 && line[2 + n] == ':')
+                        return line + 2 + n + 1 + strspn(line + 2 + n + 1, " \t");
+        return NULL;
+}
+
+/* Get the preferred encoding from the Accept-Encoding header of the
+ * request R, read into BUF. Encodings explicitly disabled with q=0 are
+ * ignored. */
+static enum page_encoding
+accepted_encoding(const Http_Request *r, const char *buf)
+{
+        char line[256];
+        const char *value;
+        const char *end;
+        const char *tok;
+        const char *next;
+        const char *p;
+        const char *q;
+        size_t n;
+
+        if ((value = http_header(r, buf, "Accept-Encoding", &n)) == NULL)
+                return ENC_IDENTITY;
+
+        /* Null terminated. Encodings after 255 bytes are ignored */
+        snprintf(line, sizeof line, "%.*s", (int) n, value);
+        end = line + strlen(line);
+
+        for (int enc = ENC_GZIP; enc < ENC_COUNT; enc++) {
+                n = strlen(page_encoding_names[enc]);
+                for (tok = line; tok < end; tok = next) {
+                        next = tok + strcspn(tok, ",") + 1;
+                        tok += strspn(tok, " \t");
+                        if (strncasecmp(tok, page_encoding_names[enc], n))
+                                continue;
+                        p = tok + n + strspn(tok + n, " \t");
+                        if (*p != ',' && *p != ';' && p < end)
+                                continue;
+                        if (*p == ';' && (q = strchr(p, '=')) && q < next && strtod(q + 1, NULL) == 0)
+                                continue;
+                        return enc;
+                }
+        }
+        return ENC_IDENTITY;
+}
+
+/* Render the whole html page of the tasks of S into STREAM. Forms are
+ * sent to BASE, the url of the list. */
+static void
+render_page(Store *s, FILE *stream, const char *base)
+{
+        char css_path[PATH_MAX];
+        struct stat st = { 0 };
+        Occurrence_da occ;
+        Row_da rows;
+
+        store_sort(s);
+
+        /* ---------- INLINE HTML ---------- */
+
+        fprintf(stream, "<!DOCTYPE html>");
+        fprintf(stream, "<html>");
+        fprintf(stream, "<head>");
+
+        /* The css is served apart, see serve_asset(). Its time is in the
+         * url, so browsers cache it until it changes */
+        snprintf(css_path, sizeof css_path, "%s/" CSS_FILENAME, *assets_dir);
+        if (stat(css_path, &st) < 0)
+                LOGW("Cant load css file '%s'\n", css_path);
+        fprintf(stream, "<link rel=\"stylesheet\" href=\"/assets/" CSS_FILENAME "?v=%lld\">",
+                (long long) st.st_mtim.tv_sec);
+
+        fprintf(stream, "</head>");
+        fprintf(stream, "<body>");
+        fprintf(stream, "<title>");
+        fprintf(stream, "Todo");
+        fprintf(stream, "</title>");
+        fprintf(stream, "<h1>");
+        fprintf(stream, "Tasks");
+        fprintf(stream, "</h1>");
+        fprintf(stream, "<dl>");
+
+        rows = store_rows(s);
+        occ = occurrences(s, rows, time(NULL) + RECUR_VIEW_DAYS * 24 * 3600);
+        for_da_each(o, occ)
+        {
+                Task e = store_get(s, o->row);
+                fprintf(stream, "<dt>");
+                fprintf(stream, "%s", e.name);
+                fprintf(stream, "<form action=\"%s\" method=\"GET\" style=\"display:inline;\">", base);
+                fprintf(stream, "<input type=\"hidden\" name=\"button\" value=\"%d\">", o->row);
+                fprintf(stream, "<button type=\"submit\">Done</button>");
+                fprintf(stream, "</form>");
+                fprintf(stream, "<dd>");
+                fprintf(stream, "%s", overload_date(o->due));
+                if (e.repeat)
+                        fprintf(stream, " (%s)", e.repeat);
+                fprintf(stream, "</dd>");
+                if (e.desc) {
+                        fprintf(stream, "<dd><p>");
+                        fprintf(stream, "%s\n", e.desc);
+                        fprintf(stream, "</p></dd>");
+                }
+        }
+
+        da_destroy(&occ);
+        da_destroy(&rows);
+
+        fprintf(stream, "</dl>");
+        fprintf(stream, "<br>");
+        fprintf(stream, "<form action=\"%s\" method=\"GET\" style=\"display:inline;\">", base);
+        fprintf(stream, "<input type=\"hidden\" name=\"button\" value=\"%d\">", -1);
+        fprintf(stream, "<button type=\"submit\">Save</button>");
+        fprintf(stream, "</form>");
+        fprintf(stream, "</body>");
+        fprintf(stream, "</html>");
+}
+
+/* Get a reference to the current page of the list L, rendering it again
+ * only if its tasks or the css file changed since the last render. The
+ * returned page has to be released with page_release(). */
+static struct page *
+page_get(Todo_List *l, enum page_encoding enc)
+{
+        struct page_cache *cache = &l->cache;
+        char base[LIST_NAME_MAX + 16];
+        char css_path[PATH_MAX];
+        struct page *page;
+        FILE *stream;
+        struct stat st = { 0 };
+
+        snprintf(css_path, sizeof css_path, "%s/" CSS_FILENAME, *assets_dir);
+        stat(css_path, &st);
+        snprintf(base, sizeof base, l->name[0] ? "/list/%s/" : "/", l->name);
+
+        pthread_mutex_lock(&cache->lock);
+        list_lock(l);
+
+        if (cache->page == NULL || cache->gen != l->gen ||
+            cache->hour != time(NULL) / 3600 ||
+            cache->css_mtime.tv_sec != st.st_mtim.tv_sec ||
+            cache->css_mtime.tv_nsec != st.st_mtim.tv_nsec) {
+                if (cache->page)
+                        page_release(cache->page);
+                page = calloc(1, sizeof *page);
+                assert(page);
+                page->refs = 1;
+
+                stream = open_memstream(&page->body[ENC_IDENTITY], &page->len[ENC_IDENTITY]);
+                assert(stream);
+                render_page(&l->data, stream, base);
+                fclose(stream);
+
+                counter_add(&m_renders, 1);
+                cache->gen = l->gen;
+                cache->css_mtime = st.st_mtim;
+                cache->hour = time(NULL) / 3600;
+                cache->page = page;
+        }
+        list_unlock(l);
+
+        page = cache->page;
+        if (enc != ENC_IDENTITY && page->body[enc] == NULL)
+                page->body[enc] = compress_buf(page->body[ENC_IDENTITY],
+                                               page->len[ENC_IDENTITY],
+                                               enc, &page->len[enc]);
+
+        __atomic_add_fetch(&page->refs, 1, __ATOMIC_ACQ_REL);
+        pthread_mutex_unlock(&cache->lock);
+        return page;
+}
+
+/* Print the metrics of the daemon to STREAM, in prometheus text format */
+static void
+metrics_write(FILE *stream)
+{
+        long tasks = 0;
+
+        counter_print(stream, &m_requests, 1);
+        counter_print(stream, &m_sent_bytes, 1);
+        counter_print(stream, &m_renders, 1);
+        counter_print(stream, &m_shed, 1);
+        counter_print(stream, &m_timeouts, 1);
+        counter_print(stream, &m_reminders, 1);
+        for (int i = 0; i < PHASE_COUNT; i++)
+                hist_print(stream, &m_phase[i], i == 0);
+        hist_print(stream, &m_save, 1);
+        fprintf(stream, "# HELP todo_log_dropped_total Log records dropped because a ring was full\n");
+        fprintf(stream, "# TYPE todo_log_dropped_total counter\n");
+        fprintf(stream, "todo_log_dropped_total %llu\n", (unsigned long long) log_dropped());
+        /* Lists being loaded are not waited for */
+        pthread_mutex_lock(&lists.lock);
+        for_da_each(l, lists.all)
+        {
+                if (pthread_mutex_trylock(&(*l)->lock) == 0) {
+                        tasks += (*l)->data.size;
+                        pthread_mutex_unlock(&(*l)->lock);
+                }
+        }
+        gauge_print(stream, "todo_lists", "Lists loaded", lists.all.size);
+        pthread_mutex_unlock(&lists.lock);
+        gauge_print(stream, "todo_tasks", "Tasks in the loaded lists", tasks);
+        gauge_print(stream, "todo_http_connections", "Connections being served",
+                    __atomic_load_n(&connections, __ATOMIC_RELAXED));
+}
+
+/* Answer GET /metrics, or HEAD without the body if HEAD */
+static void
+serve_metrics(int clientfd, bool keep_alive, bool head)
+{
+        char *body = NULL;
+        size_t len = 0;
+        FILE *stream;
+
+        stream = open_memstream(&body, &len);
+        if (stream == NULL) {
+                LOGE("open_memstream: %s\n", strerror(errno));
+                return;
+        }
+        metrics_write(stream);
+        fclose(stream);
+
+        dprintf(clientfd, "HTTP/1.1 200 OK\r\n");
+        dprintf(clientfd, "Content-Type: text/plain; version=0.0.4\r\n");
+        dprintf(clientfd, "Content-Length: %zu\r\n", len);
+        dprintf(clientfd, "Connection: %s\r\n", keep_alive ? "keep-alive" : "close");
+        dprintf(clientfd, "\r\n");
+        if (!head && send(clientfd, body, len, MSG_NOSIGNAL) < 0)
+                LOGW("send: %s\n", strerror(errno));
+        free(body);
+}
+
+/* Send a response with no body */
+static void
+serve_empty(int clientfd, const char *status, bool keep_alive)
+{
+        dprintf(clientfd, "HTTP/1.1 %s\r\n", status);
+        dprintf(clientfd, "Content-Length: 0\r\n");
+        dprintf(clientfd, "Connection: %s\r\n", keep_alive ? "keep-alive" : "close");
+        dprintf(clientfd, "\r\n");
+}
+
+static const struct {
+        const char *ext;
+        const char *type;
+} asset_types[] = {
+        { ".css", "text/css" },
+        { ".js", "text/javascript" },
+        { ".html", "text/html" },
+        { ".txt", "text/plain" },
+        { ".ico", "image/x-icon" },
+        { ".png", "image/png" },
+        { ".jpg", "image/jpeg" },
+        { ".jpeg", "image/jpeg" },
+        { ".gif", "image/gif" },
+        { ".svg", "image/svg+xml" },
+        { ".webp", "image/webp" },
+        { ".woff2", "font/woff2" },
+};
+
+static const char *
+asset_type(const char *name)
+{
+        const char *ext = strrchr(name, '.');
+        for (size_t i = 0; ext && i < sizeof asset_types / sizeof *asset_types; i++)
+                if (strcasecmp(ext, asset_types[i].ext) == 0)
+                        return asset_types[i].type;
+        return "application/octet-stream";
+}
+
+/* Send the file NAME of -assets_dir. The file is copied to the socket by
+ * the kernel with sendfile(), and browsers can cache it: it is sent with
+ * its modification time, and not sent again if it did not change since
+ * the If-Modified-Since date of the request R. HEAD requests only get the
+ * head */
+static bool
+serve_asset(int clientfd, const Http_Request *r, const char *buf, const char *name, bool keep_alive)
+{
+        char path[PATH_MAX];
+        char head[512];
+        char date[64];
+        char since[64];
+        const char *value;
+        size_t value_len;
+        struct stat st;
+        struct tm tm;
+        off_t off = 0;
+        ssize_t n;
+        int len;
+        int fd;
+
+        /* Only files of the directory, without hidden ones */
+        if (name[0] == 0 || name[0] == '.' || strchr(name, '/') ||
+            snprintf(path, sizeof path, "%s/%s", *assets_dir, name) >= (int) sizeof path ||
+            (fd = open(path, O_RDONLY)) < 0) {
+                serve_empty(clientfd, "404 Not Found", keep_alive);
+                return keep_alive;
+        }
+        if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+                close(fd);
+                serve_empty(clientfd, "404 Not Found", keep_alive);
+                return keep_alive;
+        }
+
+        gmtime_r(&st.st_mtim.tv_sec, &tm);
+        strftime(date, sizeof date, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+
+        if ((value = http_header(r, buf, "If-Modified-Since", &value_len))) {
+                snprintf(since, sizeof since, "%.*s", (int) value_len, value);
+                memset(&tm, 0, sizeof tm);
+                if (strptime(since, "%a, %d %b %Y %H:%M:%S GMT", &tm) &&
+                    st.st_mtim.tv_sec <= tz_timegm(&tm)) {
+                        close(fd);
+                        dprintf(clientfd, "HTTP/1.1 304 Not Modified\r\n");
+                        dprintf(clientfd, "Last-Modified: %s\r\n", date);
+                        dprintf(clientfd, "Cache-Control: public, max-age=%d\r\n", *assets_max_age);
+                        dprintf(clientfd, "Connection: %s\r\n", keep_alive ? "keep-alive" : "close");
+                        dprintf(clientfd, "\r\n");
+                        return keep_alive;
+                }
+        }
+
+        /* The head is sent with MSG_MORE, so it goes in the same packet as
+         * the start of the file */
+        len = snprintf(head, sizeof head,
+                       "HTTP/1.1 200 OK\r\n"
+                       "Content-Type: %s\r\n"
+                       "Content-Length: %lld\r\n"
+                       "Last-Modified: %s\r\n"
+                       "Cache-Control: public, max-age=%d\r\n"
+                       "Connection: %s\r\n"
+                       "\r\n",
+                       asset_type(name), (long long) st.st_size, date,
+                       *assets_max_age, keep_alive ? "keep-alive" : "close");
+        if (http_span_is(buf, r->method, "HEAD"))
+                st.st_size = 0;
+        if (send(clientfd, head, len, MSG_NOSIGNAL | (st.st_size ? MSG_MORE : 0)) < 0) {
+                LOGW("send: %s\n", strerror(errno));
+                close(fd);
+                return false;
+        }
+
+        while (off < st.st_size) {
+                if ((n = sendfile(clientfd, fd, &off, st.st_size - off)) <= 0) {
+                        if (n < 0 && errno == EINTR)
+                                continue;
+                        /* The file was truncated or the client is gone */
+                        LOGW("sendfile %s: %s\n", path, n ? strerror(errno) : "short file");
+                        keep_alive = false;
+                        break;
+                }
+        }
+        counter_add(&m_sent_bytes, off);
+        close(fd);
+        return keep_alive;
+}
+
+enum api_filter {
+        API_SEARCH = 0,
+        API_QUERY,
+};
+
+/* Answer GET /api/search?q=WORDS and GET /api/query?q=QUERY with the
+ * matching tasks of the list L as json, sorted by date, or only with the
+ * head if HEAD. QUERY is the decoded q parameter */
+static void
+serve_api(int clientfd, Todo_List *l, const char *query, bool keep_alive, bool head, enum api_filter filter)
+{
+        const char *error = NULL;
+        char *body = NULL;
+        size_t len = 0;
+        FILE *stream;
+        Occurrence_da occ;
+        Row_da found;
+
+        stream = open_memstream(&body, &len);
+        if (stream == NULL) {
+                LOGE("open_memstream: %s\n", strerror(errno));
+                serve_empty(clientfd, "500 Internal Server Error", false);
+                return;
+        }
+
+        list_lock(l);
+        found = filter == API_QUERY ? tasks_where(&l->data, query, &error) : tasks_matching(&l->data, query);
+        /* Sorted by date, without the next occurrences of recurring tasks */
+        occ = occurrences(&l->data, found, RANGE_TIME_MIN);
+        if (error) {
+                fprintf(stream, "{\"error\":");
+                json_write_str(stream, error);
+                fprintf(stream, "}");
+        } else
+                fprintf(stream, "[");
+        for_da_each(o, occ)
+        {
+                fprintf(stream, "%s", da_index(o, occ) ? "," : "");
+                write_task_json(&l->data, stream, o->row);
+        }
+        if (!error)
+                fprintf(stream, "]");
+        list_unlock(l);
+        da_destroy(&occ);
+        da_destroy(&found);
+        fclose(stream);
+
+        dprintf(clientfd, "HTTP/1.1 %s\r\n", error ? "400 Bad Request" : "200 OK");
+        dprintf(clientfd, "Content-Type: application/json\r\n");
+        dprintf(clientfd, "Content-Length: %zu\r\n", len);
+        dprintf(clientfd, "Connection: %s\r\n", keep_alive ? "keep-alive" : "close");
+        dprintf(clientfd, "\r\n");
+        if (!head && send(clientfd, body, len, MSG_NOSIGNAL) < 0)
+                LOGW("send: %s\n", strerror(errno));
+        else if (!head)
+                counter_add(&m_sent_bytes, len);
+        free(body);
+}
+
+/* Get the list of the decoded request PATH, and the path inside the list
+ * into *REST. /list/NAME/... is the list NAME and any other path is the
+ * default list. Returns NULL if NAME is not valid. */
+static Todo_List *
+request_list(const char *path, const char **rest)
+{
+        char name[LIST_NAME_MAX + 1] = "";
+        size_t n;
+
+        *rest = path;
+        if (strncmp(path, "/list/", 6) == 0) {
+                n = strcspn(path + 6, "/");
+                if (n > LIST_NAME_MAX)
+                        return NULL;
+                memcpy(name, path + 6, n);
+                name[n] = 0;
+                if (!list_name_valid(name))
+                        return NULL;
+                /* /list/NAME is /list/NAME/ */
+                *rest = path[6 + n] ? path + 6 + n : "/";
+        }
+        return list_get(name);
+}
+
+/* Wait until FD can be read or DEADLINE, as metrics_now_ns(). If IDLE
+ * it stops waiting when the daemon stops too. Returns 1 if it can be
+ * read, 0 on timeout and -1 if the daemon is stopping */
+static int
+serve_wait(int fd, uint64_t deadline, bool idle)
+{
+        struct pollfd p[2] = {
+                { .fd = fd, .events = POLLIN },
+                { .fd = idle ? serve_stop[0] : -1, .events = POLLIN },
+        };
+        uint64_t now;
+        int n;
+
+        do {
+                if ((now = metrics_now_ns()) >= deadline)
+                        return 0;
+                n = poll(p, 2, (deadline - now + 999999) / 1000000);
+        } while (n < 0 && errno == EINTR);
+        if (n > 0 && p[1].revents)
+                return -1;
+        /* Errors and hangups are seen by read() */
+        return n != 0;
+}
+
+/* A reminder that fired, as sent to the hooks */
+struct remind_event {
+        char list[LIST_NAME_MAX + 1];
+        char *name;
+        time_t due;
+};
+
+typedef DA(struct remind_event) Remind_Event_da;
+
+/* Last reminders fired, for the /api/events clients. Event SEQ is at
+ * RING[SEQ % REMIND_EVENTS] */
+static struct {
+        pthread_mutex_t lock;
+        struct remind_event ring[REMIND_EVENTS];
+        uint64_t seq; /* of the next event */
+} events = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/* Called by wheel_advance() with REMINDERS.LOCK held, so the hooks run
+ * after it is released. The reminder stays with its task until it is
+ * done or removed */
+static void
+reminder_fire(Wheel_Timer *t, void *arg)
+{
+        struct reminder *r = (struct reminder *) t;
+        struct remind_event e = { .due = r->due, .name = strdup(r->name) };
+
+        assert(e.name);
+        strcpy(e.list, r->list);
+        da_append((Remind_Event_da *) arg, e);
+}
+
+/* Run -remind_exec with sh, with the task in TASK_NAME, TASK_DUE (seconds
+ * since the epoch) and TASK_LIST. It is not waited for. TODO_ variables
+ * are not used, as they would be flags of a todo run by the command */
+static void
+remind_hook_exec(const struct remind_event *e)
+{
+        char *argv[] = { "sh", "-c", *remind_exec, NULL };
+        char due[32];
+        char list[LIST_NAME_MAX + 16];
+        char *name;
+        char **env;
+        pid_t pid;
+        int n = 0;
+
+        while (environ[n])
+                ++n;
+        env = malloc(sizeof *env * (n + 4));
+        name = malloc(strlen(e->name) + 16);
+        assert(env && name);
+        sprintf(name, "TASK_NAME=%s", e->name);
+        snprintf(due, sizeof due, "TASK_DUE=%lld", (long long) e->due);
+        snprintf(list, sizeof list, "TASK_LIST=%s", e->list);
+        env[0] = name;
+        env[1] = due;
+        env[2] = list;
+        memcpy(env + 3, environ, sizeof *env * (n + 1));
+
+        /* Forked twice so it is not a child to wait for */
+        if ((pid = fork()) == 0) {
+                if (fork() == 0) {
+                        execve("/bin/sh", argv, env);
+                        _exit(127);
+                }
+                _exit(0);
+        }
+        if (pid < 0)
+                LOGE("fork: %s\n", strerror(errno));
+        else
+                waitpid(pid, NULL, 0);
+        free(name);
+        free(env);
+}
+
+/* Write a line DUE TAB LIST TAB NAME to -remind_fifo. It is skipped if
+ * nobody is reading the fifo */
+static void
+remind_hook_fifo(const struct remind_event *e)
+{
+        char *line;
+        int len;
+        int fd;
+
+        if ((fd = open(*remind_fifo, O_WRONLY | O_NONBLOCK | O_APPEND | O_CLOEXEC)) < 0) {
+                if (errno == ENXIO)
+                        LOGD("No reader at %s\n", *remind_fifo);
+                else
+                        LOGW("open %s: %s\n", *remind_fifo, strerror(errno));
+                return;
+        }
+        line = malloc(strlen(e->name) + sizeof e->list + 32);
+        assert(line);
+        len = sprintf(line, "%lld\t%s\t%s\n", (long long) e->due, e->list, e->name);
+        if (write(fd, line, len) != len)
+                LOGW("write %s: %s\n", *remind_fifo, strerror(errno));
+        free(line);
+        close(fd);
+}
+
+/* Run the hooks of the event E, that is owned by EVENTS after this call */
+static void
+remind(struct remind_event *e)
+{
+        struct remind_event *slot;
+
+        LOGI("Reminder: %s%s%s\n", e->list, *e->list ? ": " : "", e->name);
+        counter_add(&m_reminders, 1);
+        if (*remind_exec)
+                remind_hook_exec(e);
+        if (*remind_fifo)
+                remind_hook_fifo(e);
+
+        pthread_mutex_lock(&events.lock);
+        slot = &events.ring[events.seq++ % REMIND_EVENTS];
+        free(slot->name);
+        *slot = *e;
+        pthread_mutex_unlock(&events.lock);
+}
+
+/* Scheduler thread. The wheel is advanced each second, so only the
+ * reminders that are due are touched, and the lists are never scanned */
+static void *
+reminders_run(void *arg)
+{
+        struct pollfd stop = { .fd = serve_stop[0], .events = POLLIN };
+        Remind_Event_da fired = { 0 };
+        Todo_List *l;
+        (void) arg;
+
+        /* The default list is reminded from the start, the others once
+         * they are loaded */
+        l = list_get("");
+        list_lock(l);
+        list_unlock(l);
+        list_put(l);
+
+        /* A daemon that is stopping leaves them to the next one */
+        while (poll(&stop, 1, 1000) <= 0) {
+                pthread_mutex_lock(&reminders.lock);
+                wheel_advance(&reminders.wheel, time(NULL), reminder_fire, &fired);
+                pthread_mutex_unlock(&reminders.lock);
+                for_da_each(e, fired)
+                        remind(e);
+                fired.size = 0;
+        }
+        da_destroy(&fired);
+        return NULL;
+}
+
+/* Remind the tasks of the lists loaded from now on, in a thread */
+static void
+reminders_start()
+{
+        pthread_t thread_id;
+        int status;
+
+        wheel_init(&reminders.wheel, time(NULL));
+        reminders.running = true;
+        if ((status = pthread_create(&thread_id, NULL, reminders_run, NULL)) != 0)
+                LOGE("pthread_create: %s\n", strerror(status));
+        else
+                pthread_detach(thread_id);
+}
+
+/* Answer GET /api/events with a stream of server sent events, an event
+ * "due" for each reminder of the list L fired from now on. The
+ * connection is kept, and so is L loaded, until the client closes it or
+ * the daemon stops. HEAD only gets the head. Returns false */
+static bool
+serve_events(int clientfd, Todo_List *l, bool head)
+{
+        uint64_t keep_alive = metrics_now_ns() + EVENTS_KEEP_ALIVE * 1000000000ull;
+        struct remind_event *e;
+        char *body;
+        size_t len;
+        FILE *stream;
+        uint64_t seq;
+
+        /* Its reminders are scheduled when it is loaded */
+        list_lock(l);
+        list_unlock(l);
+
+        dprintf(clientfd, "HTTP/1.1 200 OK\r\n");
+        dprintf(clientfd, "Content-Type: text/event-stream\r\n");
+        dprintf(clientfd, "Cache-Control: no-cache\r\n");
+        dprintf(clientfd, "Connection: close\r\n");
+        dprintf(clientfd, "\r\n");
+        if (head)
+                return false;
+
+        pthread_mutex_lock(&events.lock);
+        seq = events.seq;
+        pthread_mutex_unlock(&events.lock);
+
+        /* Clients do not send anything, so data or a hangup ends it */
+        while (serve_wait(clientfd, metrics_now_ns() + 1000000000ull, true) == 0) {
+                body = NULL;
+                len = 0;
+                if ((stream = open_memstream(&body, &len)) == NULL) {
+                        LOGE("open_memstream: %s\n", strerror(errno));
+                        break;
+                }
+                pthread_mutex_lock(&events.lock);
+                /* Events older than the ring are lost */
+                if (events.seq - seq > REMIND_EVENTS)
+                        seq = events.seq - REMIND_EVENTS;
+                for (; seq < events.seq; seq++) {
+                        e = &events.ring[seq % REMIND_EVENTS];
+                        if (strcmp(e->list, l->name) != 0)
+                                continue;
+                        fprintf(stream, "event: due\nid: %llu\ndata: {\"due\":%lld,\"name\":",
+                                (unsigned long long) seq, (long long) e->due);
+                        json_write_str(stream, e->name);
+                        fprintf(stream, "}\n\n");
+                }
+                pthread_mutex_unlock(&events.lock);
+                /* Proxies close connections that are idle for long */
+                if (ftell(stream) == 0 && metrics_now_ns() >= keep_alive)
+                        fprintf(stream, ": keep-alive\n\n");
+                fclose(stream);
+
+                if (len && send(clientfd, body, len, MSG_NOSIGNAL) < 0) {
+                        free(body);
+                        break;
+                }
+                if (len) {
+                        counter_add(&m_sent_bytes, len);
+                        keep_alive = metrics_now_ns() + EVENTS_KEEP_ALIVE * 1000000000ull;
+                }
+                free(body);
+        }
+        return false;
+}
+
+/* Handle the request R, whose head was read into BUF. T0 is the time the
+ * head was received. Returns true if the connection can be used for more
+ * requests. */
+static bool
+serve_request(int clientfd, const Http_Request *r, const char *buf, uint64_t t0)
+{
+        enum page_encoding enc;
+        struct page *page;
+        long clicked_elem_index;
+        char path[1024];
+        char arg[256];
+        const char *rest;
+        char *end;
+        Todo_List *l;
+        bool keep_alive;
+        bool head;
+        uint64_t t1;
+
+        counter_add(&m_requests, 1);
+        keep_alive = http_keep_alive(r, buf);
+
+        /* HEAD is answered as GET, without the body */
+        head = http_span_is(buf, r->method, "HEAD");
+        if (!head && !http_span_is(buf, r->method, "GET")) {
+                dprintf(clientfd, "HTTP/1.1 405 Method Not Allowed\r\n");
+                dprintf(clientfd, "Allow: GET, HEAD\r\n");
+                dprintf(clientfd, "Content-Length: 0\r\n");
+                dprintf(clientfd, "Connection: %s\r\n", keep_alive ? "keep-alive" : "close");
+                dprintf(clientfd, "\r\n");
+                return keep_alive;
+        }
+
+        if (http_decode(path, sizeof path, buf + r->path.off, r->path.len, false) < 0) {
+                serve_empty(clientfd, "400 Bad Request", false);
+                return false;
+        }
+
+        /* Assets are shared by all lists */
+        if (strncmp(path, "/assets/", 8) == 0)
+                return serve_asset(clientfd, r, buf, path + 8, keep_alive);
+        if (strcmp(path, "/favicon.ico") == 0)
+                return serve_asset(clientfd, r, buf, "favicon.ico", keep_alive);
+
+        if ((l = request_list(path, &rest)) == NULL) {
+                serve_empty(clientfd, "404 Not Found", keep_alive);
+                return keep_alive;
+        }
+
+        if (strcmp(rest, "/api/search") == 0 || strcmp(rest, "/api/query") == 0) {
+                if (http_query(r, buf, "q", arg, sizeof arg) < 0)
+                        arg[0] = 0;
+                serve_api(clientfd, l, arg, keep_alive, head, rest[5] == 'q' ? API_QUERY : API_SEARCH);
+                list_put(l);
+                return keep_alive;
+        }
+
+        if (strcmp(rest, "/api/events") == 0) {
+                keep_alive = serve_events(clientfd, l, head);
+                list_put(l);
+                return keep_alive;
+        }
+
+        if (strcmp(rest, "/metrics") == 0) {
+                list_put(l);
+                serve_metrics(clientfd, keep_alive, head);
+                return keep_alive;
+        }
+
+        if (strcmp(rest, "/") != 0) {
+                list_put(l);
+                serve_empty(clientfd, "404 Not Found", keep_alive);
+                return keep_alive;
+        }
+
+        /* HEAD is safe, it does not press buttons */
+        if (!head && http_query(r, buf, "button", arg, sizeof arg) > 0 &&
+            (clicked_elem_index = strtol(arg, &end, 10), *end == 0)) {
+                list_lock(l);
+                switch (clicked_elem_index) {
+                default:
+                        /* Buttons from 0 to tasks num - 1 */
+                        if (clicked_elem_index <= INT_MAX &&
+                            store_complete(&l->data, clicked_elem_index)) {
+                                ++l->gen;
+                                /* The file is saved later, the summary now */
+                                summary_update(&l->data, l->out_file);
+                        }
+                        break;
+                case -1:
+                        /* Save button */
+                        load_to_file(&l->data, l->out_file);
+                        l->saved_gen = l->gen;
+                        break;
+                }
+                list_unlock(l);
+        }
+
+        enc = accepted_encoding(r, buf);
+
+        t1 = metrics_now_ns();
+        hist_record(&m_phase[PHASE_PARSE], t1 - t0);
+        t0 = t1;
+
+        page = page_get(l, enc);
+        list_put(l);
+
+        t1 = metrics_now_ns();
+        hist_record(&m_phase[PHASE_RENDER], t1 - t0);
+        t0 = t1;
+
+        /* Compression may fail, fallback to plain html */
+        if (page->body[enc] == NULL)
+                enc = ENC_IDENTITY;
+
+        dprintf(clientfd, "HTTP/1.1 200 OK\r\n");
+        dprintf(clientfd, "Content-Type: text/html\r\n");
+        if (enc != ENC_IDENTITY)
+                dprintf(clientfd, "Content-Encoding: %s\r\n", page_encoding_names[enc]);
+        dprintf(clientfd, "Vary: Accept-Encoding\r\n");
+        dprintf(clientfd, "Content-Length: %zu\r\n", page->len[enc]);
+        dprintf(clientfd, "Connection: %s\r\n", keep_alive ? "keep-alive" : "close");
+        dprintf(clientfd, "\r\n");
+
+        if (!head && send(clientfd, page->body[enc], page->len[enc], MSG_NOSIGNAL) < 0) {
+                LOGW("send: %s\n", strerror(errno));
+                keep_alive = false;
+        } else if (!head)
+                counter_add(&m_sent_bytes, page->len[enc]);
+
+        hist_record(&m_phase[PHASE_SEND], metrics_now_ns() - t0);
+        page_release(page);
+        return keep_alive;
+}
+
+/* Connection thread. Requests are served until the client closes the
+ * connection or asks to close it. */
+static void *
+serve_gen_response(void *args)
+{
+        struct serve_data sdata = *(struct serve_data *) args;
+        size_t size = *bufsize / 64;
+        struct timeval send_timeout = {
+                .tv_sec = *write_timeout / 1000,
+                .tv_usec = *write_timeout % 1000 * 1000,
+        };
+        Http_Request r;
+        uint64_t deadline;
+        long long body;
+        char *req;
+        size_t len = 0;
+        bool keep_alive;
+        ssize_t n;
+        int status;
+
+        free(args);
+        hist_record(&m_phase[PHASE_ACCEPT], metrics_now_ns() - sdata.accepted_ns);
+
+        if (sdata.clientfd < 0) {
+                LOGE("invalid clientfd\n");
+                return NULL;
+        }
+
+        /* Sends to clients that do not read fail after -write_timeout */
+        if (setsockopt(sdata.clientfd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof send_timeout) < 0)
+                LOGW("SO_SNDTIMEO: %s\n", strerror(errno));
+
+        req = malloc(size);
+        assert(req);
+
+        do {
+                /* Read until there is a whole request head in REQ. Only
+                 * the new bytes are parsed after each read. The whole
+                 * head has to arrive in -read_timeout, so clients can not
+                 * keep the thread sending a byte at a time */
+                http_init(&r);
+                deadline = metrics_now_ns() + *read_timeout * 1000000ull;
+                while ((status = http_parse(&r, req, len)) == HTTP_PARTIAL) {
+                        if (len == size) {
+                                serve_empty(sdata.clientfd, "431 Request Header Fields Too Large", false);
+                                goto close;
+                        }
+                        switch (serve_wait(sdata.clientfd, deadline, len == 0)) {
+                        case 0:
+                                counter_add(&m_timeouts, 1);
+                                /* Idle keep alive connections just close */
+                                if (len > 0)
+                                        serve_empty(sdata.clientfd, "408 Request Timeout", false);
+                                goto close;
+                        case -1:
+                                goto close;
+                        }
+                        switch (n = read(sdata.clientfd, req + len, size - len)) {
+                        case 0:
+                                goto close;
+                        case -1:
+                                LOGW("read: %s\n", strerror(errno));
+                                goto close;
+                        default:
+                                len += n;
+                        }
+                }
+                if (status != HTTP_DONE) {
+                        serve_empty(sdata.clientfd, status == HTTP_TOO_MANY_HEADERS ? "431 Request Header Fields Too Large" : "400 Bad Request", false);
+                        goto close;
+                }
+
+                keep_alive = serve_request(sdata.clientfd, &r, req, metrics_now_ns());
+
+                /* Bodies are not used. Skip them and keep pipelined
+                 * requests */
+                body = r.content_length;
+                if (body > (long long) (len - r.head_len)) {
+                        for (body -= len - r.head_len; keep_alive && body > 0; body -= n)
+                                if (serve_wait(sdata.clientfd, deadline, false) <= 0 ||
+                                    (n = read(sdata.clientfd, req, body < (long long) size ? (size_t) body : size)) <= 0)
+                                        goto close;
+                        len = 0;
+                } else {
+                        memmove(req, req + r.head_len + body, len - r.head_len - body);
+                        len -= r.head_len + body;
+                }
+        } while (keep_alive);
+
+close:
+        close(sdata.clientfd);
+        free(req);
+        __atomic_sub_fetch(&connections, 1, __ATOMIC_RELAXED);
+        return NULL;
+}
+
+/* Create a socket listening at ADDR. If *PORT is in use next ports are
+ * tried. If *PORT is 0 a free port is chosen by the system. *PORT is
+ * updated to the port used. If SHARED other sockets with SHARED set can
+ * listen at the same port. Returns the socket or -1 on error. */
+static int
+serve_listen(in_addr_t addr, int *port, bool shared)
+{
+        struct sockaddr_in sock_in = { 0 };
+        socklen_t addr_len = sizeof sock_in;
+        int first_port = *port;
+        int sockfd;
+
+        /* Non blocking, as another daemon can accept the connection after
+         * poll(), see serve_handoff() */
+        sockfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (sockfd < 0) {
+                perror("Socket");
+                return -1;
+        }
+
+        if (shared && setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &(int) { 1 }, sizeof(int)) < 0) {
+                perror("SO_REUSEPORT");
+                close(sockfd);
+                return -1;
+        }
+
+        sock_in.sin_family = AF_INET;
+        sock_in.sin_addr.s_addr = htonl(addr);
+
+retry:
+        errno = 0;
+        sock_in.sin_port = htons(*port);
+
+        if (bind(sockfd, (struct sockaddr *) &sock_in, sizeof(struct sockaddr_in)) < 0) {
+                if (errno == EADDRINUSE && *port != 0) {
+                        ++*port;
+                        if (*port - first_port > *max_attempts) {
+                                perror("Bind max attempts");
+                                close(sockfd);
+                                return -1;
+                        }
+                        goto retry;
+                }
+                perror("Bind");
+                close(sockfd);
+                return -1;
+        }
+
+        if (listen(sockfd, *max_clients) < 0) {
+                perror("Listen");
+                close(sockfd);
+                return -1;
+        }
+
+        if (*port == 0) {
+                getsockname(sockfd, (struct sockaddr *) &sock_in, &addr_len);
+                *port = ntohs(sock_in.sin_port);
+        }
+
+        return sockfd;
+}
+
+/* Answer the connection CLIENTFD with 503 without waiting for it, and
+ * close it */
+static void
+serve_shed(int clientfd)
+{
+        static const char res[] = "HTTP/1.1 503 Service Unavailable\r\n"
+                                  "Retry-After: 1\r\n"
+                                  "Content-Length: 0\r\n"
+                                  "Connection: close\r\n"
+                                  "\r\n";
+        char discard[1024];
+
+        counter_add(&m_shed, 1);
+        send(clientfd, res, sizeof res - 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+        /* Unread requests would make close() reset the connection before
+         * the client reads the response */
+        recv(clientfd, discard, sizeof discard, MSG_DONTWAIT);
+        shutdown(clientfd, SHUT_WR);
+        close(clientfd);
+}
+
+/* Accept connections from SOCKFD and serve each one in a new thread,
+ * until serve_stop is written. Connections over -max_connections are
+ * answered with 503 at once, so slow clients can not take every thread */
+static void
+serve_loop(int sockfd)
+{
+        struct pollfd p[2] = {
+                { .fd = sockfd, .events = POLLIN },
+                { .fd = serve_stop[0], .events = POLLIN },
+        };
+        struct sockaddr_in sock_in;
+        struct serve_data *sdata;
+        pthread_attr_t attr;
+        pthread_t thread_id;
+        socklen_t addr_len;
+        int clientfd;
+        int status;
+
+        /* Connection threads do not need the default 8 MiB */
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        pthread_attr_setstacksize(&attr, CONNECTION_STACK);
+
+        while (1) {
+                if (poll(p, 2, -1) < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        LOGE("poll: %s\n", strerror(errno));
+                        break;
+                }
+                /* The socket is of another daemon now */
+                if (p[1].revents)
+                        break;
+
+                addr_len = sizeof(struct sockaddr_in);
+
+                if (((clientfd = accept4(sockfd, (struct sockaddr *) &sock_in, &addr_len, SOCK_CLOEXEC)) < 0)) {
+                        if (errno == EAGAIN || errno == EWOULDBLOCK)
+                                continue;
+                        if (errno == EINTR || errno == ECONNABORTED || errno == EMFILE ||
+                            errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                                LOGW("accept: %s\n", strerror(errno));
+                                continue;
+                        }
+                        LOGE("accept: %s\n", strerror(errno));
+                        break;
+                }
+
+                if (__atomic_add_fetch(&connections, 1, __ATOMIC_RELAXED) > *max_connections) {
+                        __atomic_sub_fetch(&connections, 1, __ATOMIC_RELAXED);
+                        serve_shed(clientfd);
+                        continue;
+                }
+
+                /* Owned by the new thread */
+                sdata = malloc(sizeof *sdata);
+                assert(sdata);
+                *sdata = (struct serve_data) {
+                        .sock_in = sock_in,
+                        .clientfd = clientfd,
+                        .addr_len = addr_len,
+                        .accepted_ns = metrics_now_ns(),
+                };
+
+                if ((status = pthread_create(&thread_id, &attr, serve_gen_response, sdata)) != 0) {
+                        LOGE("pthread_create: %s\n", strerror(status));
+                        __atomic_sub_fetch(&connections, 1, __ATOMIC_RELAXED);
+                        serve_shed(clientfd);
+                        free(sdata);
+                }
+        }
+        pthread_attr_destroy(&attr);
+}
+
+/* Accept thread of the daemon. Every worker has its own socket listening
+ * at the same port, and the kernel spreads new connections among them, so
+ * accepts are not limited to a core. Tasks are shared by all of them, see
+ * Todo_List. */
+struct serve_worker {
+        int sockfd;
+        int cpu; /* -1 to run in any cpu */
+};
+
+static void *
+serve_worker(void *arg)
+{
+        struct serve_worker *w = arg;
+        cpu_set_t set;
+        int status;
+
+        /* Connection threads inherit it */
+        if (w->cpu >= 0) {
+                CPU_ZERO(&set);
+                CPU_SET(w->cpu, &set);
+                if ((status = pthread_setaffinity_np(pthread_self(), sizeof set, &set)) != 0)
+                        LOGW("pthread_setaffinity_np: %s\n", strerror(status));
+        }
+        serve_loop(w->sockfd);
+        return NULL;
+}
+
+/* Sockets that fit in a SCM_RIGHTS message, SCM_MAX_FD of Linux */
+#define SERVE_MAX_WORKERS 253
+
+/* Pin each of the workers W, ended by one with a negative socket, to one
+ * of the cpus this process can run on, if there are many of them */
+static void
+serve_pin_workers(struct serve_worker *w)
+{
+        cpu_set_t allowed;
+        int cpus[CPU_SETSIZE];
+        int ncpus = 0;
+        int n = 0;
+
+        while (w[n].sockfd >= 0)
+                ++n;
+        if (sched_getaffinity(0, sizeof allowed, &allowed) == 0)
+                for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+                        if (CPU_ISSET(cpu, &allowed))
+                                cpus[ncpus++] = cpu;
+        for (int i = 0; i < n; i++)
+                w[i].cpu = n > 1 && ncpus > 1 ? cpus[i % ncpus] : -1;
+}
+
+/* Create the sockets of N workers at ADDR:*PORT, as serve_listen(), or
+ * of one per cpu this process can run on if N is 0. Returns the workers,
+ * pinned by serve_pin_workers(), or NULL on error. */
+static struct serve_worker *
+serve_listen_workers(in_addr_t addr, int *port, int n)
+{
+        struct serve_worker *w;
+        cpu_set_t allowed;
+        int p;
+
+        if (n <= 0)
+                n = sched_getaffinity(0, sizeof allowed, &allowed) == 0 ? CPU_COUNT(&allowed) : 1;
+        if (n > SERVE_MAX_WORKERS)
+                n = SERVE_MAX_WORKERS;
+
+        w = calloc(n + 1, sizeof *w);
+        assert(w);
+        for (int i = 0; i < n; i++) {
+                /* The others have to get the port of the first one */
+                p = *port;
+                w[i].sockfd = serve_listen(addr, &p, n > 1);
+                if (w[i].sockfd < 0 || (i > 0 && p != *port)) {
+                        if (w[i].sockfd >= 0)
+                                close(w[i].sockfd);
+                        while (i-- > 0)
+                                close(w[i].sockfd);
+                        free(w);
+                        return NULL;
+                }
+                *port = p;
+        }
+        w[n].sockfd = -1;
+        serve_pin_workers(w);
+        return w;
+}
+
+/* Run the workers W, ended by one with a negative socket. The first one
+ * runs in this thread, so it returns when they stop */
+static void
+serve_workers(struct serve_worker *w)
+{
+        pthread_t thread_id;
+        int status;
+
+        for (int i = 1; w[i].sockfd >= 0; i++) {
+                if ((status = pthread_create(&thread_id, NULL, serve_worker, &w[i])) != 0) {
+                        LOGE("pthread_create: %s\n", strerror(status));
+                        close(w[i].sockfd);
+                } else
+                        pthread_detach(thread_id);
+        }
+        serve_worker(&w[0]);
+}
+
+/* Unix socket of the daemon at -socket. Only processes of the same user
+ * can connect to it. Clients write a command in a line and read the
+ * answer until the socket is closed:
+ *
+ *   status   pid, port, connections, lists and uptime
+ *   stats    the metrics of /metrics
+ *   flush    save the lists that changed
+ *   reload   start this binary again with -reload
+ *   stop     finish the requests, save the lists and exit
+ *   handoff  used by -reload, see serve_handoff()
+ */
+struct serve_control {
+        int sockfd;
+        struct serve_worker *workers;
+        int port;
+        time_t started;
+        char exe[PATH_MAX]; /* this binary, for reload */
+        char **argv; /* of this daemon, for reload */
+};
+
+/* Create the socket at PATH, removing the one of the previous daemon.
+ * Returns it or -1 on error */
+static int
+control_listen(const char *path)
+{
+        struct sockaddr_un addr = { .sun_family = AF_UNIX };
+        mode_t mask;
+        int fd;
+
+        if (strlen(path) >= sizeof addr.sun_path) {
+                LOGE("%s: socket path too long\n", path);
+                return -1;
+        }
+        strcpy(addr.sun_path, path);
+
+        if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+                LOGE("socket: %s\n", strerror(errno));
+                return -1;
+        }
+        unlink(path);
+        mask = umask(077);
+        if (bind(fd, (struct sockaddr *) &addr, sizeof addr) < 0 || listen(fd, 4) < 0) {
+                LOGE("%s: %s\n", path, strerror(errno));
+                umask(mask);
+                close(fd);
+                return -1;
+        }
+        umask(mask);
+        return fd;
+}
+
+/* Connect to the socket of the daemon at PATH. Returns it or -1 */
+static int
+control_connect(const char *path)
+{
+        struct sockaddr_un addr = { .sun_family = AF_UNIX };
+        int fd;
+
+        if (strlen(path) >= sizeof addr.sun_path)
+                return -1;
+        strcpy(addr.sun_path, path);
+        if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+                return -1;
+        if (connect(fd, (struct sockaddr *) &addr, sizeof addr) < 0) {
+                close(fd);
+                return -1;
+        }
+        return fd;
+}
+
+/* Stop accepting, finish the connections being served and save the
+ * lists. Idle connections are closed */
+static void
+serve_drain()
+{
+        uint64_t deadline;
+
+        LOGI("Stopping, finishing %d connections\n",
+             __atomic_load_n(&connections, __ATOMIC_RELAXED));
+        assert(write(serve_stop[1], "", 1) == 1);
+
+        /* Requests being read have -read_timeout to arrive */
+        deadline = metrics_now_ns() + *read_timeout * 1000000ull;
+        while (__atomic_load_n(&connections, __ATOMIC_RELAXED) > 0 && metrics_now_ns() < deadline)
+                usleep(10000);
+        lists_flush();
+}
+
+/* Give the sockets of the workers W to the daemon connected at FD and
+ * serve_drain(). The other daemon starts accepting when FD is written,
+ * and this one exits */
+static void
+serve_handoff(int fd, struct serve_worker *w)
+{
+        int fds[SERVE_MAX_WORKERS];
+        char control[CMSG_SPACE(sizeof fds)] = { 0 };
+        struct iovec iov = { .iov_base = "S", .iov_len = 1 };
+        struct msghdr msg = {
+                .msg_iov = &iov,
+                .msg_iovlen = 1,
+                .msg_control = control,
+        };
+        struct cmsghdr *cmsg;
+        int n = 0;
+
+        while (w[n].sockfd >= 0)
+                fds[n] = w[n].sockfd, ++n;
+        msg.msg_controllen = CMSG_SPACE(sizeof *fds * n);
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof *fds * n);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof *fds * n);
+
+        if (sendmsg(fd, &msg, MSG_NOSIGNAL) != 1) {
+                LOGE("handoff: %s\n", strerror(errno));
+                return;
+        }
+
+        LOGI("Sockets handed off\n");
+        serve_drain();
+
+        LOGI("Handoff done\n");
+        log_stop();
+        send(fd, "D", 1, MSG_NOSIGNAL);
+        exit(0);
+}
+
+/* Start this binary again with -reload, as serve_takeover(). Returns
+ * its pid or -1 */
+static pid_t
+serve_reload(struct serve_control *c)
+{
+        char *argv[256];
+        pid_t pid;
+        int argc = 0;
+
+        while (c->argv[argc] && argc < (int) (sizeof argv / sizeof *argv) - 2) {
+                argv[argc] = c->argv[argc];
+                ++argc;
+        }
+        argv[argc++] = "-reload";
+        argv[argc] = NULL;
+
+        if ((pid = fork()) == 0) {
+                execv(c->exe, argv);
+                _exit(127);
+        }
+        /* It exits when the new daemon is forked */
+        if (pid > 0)
+                waitpid(pid, NULL, 0);
+        return pid;
+}
+
+/* Answer the command CMD of the client FD */
+static void
+serve_command(struct serve_control *c, int fd, const char *cmd)
+{
+        char *body = NULL;
+        size_t len = 0;
+        FILE *stream;
+        long tasks = 0;
+        int nworkers = 0;
+
+        if (strcmp(cmd, "handoff") == 0) {
+                serve_handoff(fd, c->workers);
+        } else if (strcmp(cmd, "status") == 0) {
+                while (c->workers[nworkers].sockfd >= 0)
+                        ++nworkers;
+                pthread_mutex_lock(&lists.lock);
+                for_da_each(l, lists.all)
+                {
+                        if (pthread_mutex_trylock(&(*l)->lock) == 0) {
+                                tasks += (*l)->data.size;
+                                pthread_mutex_unlock(&(*l)->lock);
+                        }
+                }
+                dprintf(fd, "pid %d\nport %d\nworkers %d\nconnections %d\nlists %zu\ntasks %ld\nuptime %lds\n",
+                        getpid(), c->port, nworkers, __atomic_load_n(&connections, __ATOMIC_RELAXED),
+                        (size_t) lists.all.size, tasks, (long) (time(NULL) - c->started));
+                pthread_mutex_unlock(&lists.lock);
+        } else if (strcmp(cmd, "stats") == 0) {
+                if ((stream = open_memstream(&body, &len)) != NULL) {
+                        metrics_write(stream);
+                        fclose(stream);
+                        send(fd, body, len, MSG_NOSIGNAL);
+                        free(body);
+                }
+        } else if (strcmp(cmd, "flush") == 0) {
+                lists_flush();
+                dprintf(fd, "flushed\n");
+        } else if (strcmp(cmd, "reload") == 0) {
+                if (serve_reload(c) < 0)
+                        dprintf(fd, "error: %s\n", strerror(errno));
+                else
+                        dprintf(fd, "reloading\n");
+        } else if (strcmp(cmd, "stop") == 0) {
+                serve_drain();
+                LOGI("Stopped\n");
+                log_stop();
+                dprintf(fd, "stopped\n");
+                exit(0);
+        } else {
+                dprintf(fd, "error: unknown command %s\n", cmd);
+        }
+}
+
+/* Thread of the socket of the daemon */
+static void *
+serve_control(void *arg)
+{
+        struct serve_control *c = arg;
+        struct timeval timeout = { .tv_sec = 1 };
+        struct ucred cred;
+        socklen_t cred_len;
+        char cmd[64];
+        ssize_t n;
+        int fd;
+
+        while (1) {
+                if ((fd = accept4(c->sockfd, NULL, NULL, SOCK_CLOEXEC)) < 0) {
+                        if (errno == EINTR || errno == ECONNABORTED)
+                                continue;
+                        LOGE("control accept: %s\n", strerror(errno));
                         return NULL;
                 }
-                break;
 
-        case 0:
-        case -1:
-                LOG("Internal Server Error! Reload the page\n");
-                return NULL;
-        }
+                cred_len = sizeof cred;
+                if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) < 0 ||
+                    cred.uid != getuid()) {
+                        close(fd);
+                        continue;
+                }
+                setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
 
-        qsort(data.data, data.size, sizeof *data.data, compare_tasks_by_date);
+                if ((n = read(fd, cmd, sizeof cmd - 1)) > 0) {
+                        cmd[n] = 0;
+                        cmd[strcspn(cmd, "\r\n")] = 0;
+                        LOGD("control: %s\n", cmd);
+                        serve_command(c, fd, cmd);
+                }
+                close(fd);
+        }
+}
 
-        *buf = 0; // set buf size to 0
+/* Send the command CMD to the daemon at -socket and write its answer to
+ * STREAM, if it is not NULL. Returns false if there is no daemon */
+static bool
+control_send(const char *cmd, FILE *stream)
+{
+        char buf[4096];
+        ssize_t n;
+        int fd;
 
-        /* ---------- INLINE HTML ---------- */
+        if ((fd = control_connect(*control_socket)) < 0)
+                return false;
+        if (dprintf(fd, "%s\n", cmd) < 0) {
+                close(fd);
+                return false;
+        }
+        while ((n = read(fd, buf, sizeof buf)) > 0)
+                if (stream)
+                        fwrite(buf, 1, n, stream);
+        close(fd);
+        return true;
+}
 
-        strcatf(buf, "<!DOCTYPE html>");
-        strcatf(buf, "<html>");
-        strcatf(buf, "<head>");
+/* Get the listening sockets of the daemon at the socket PATH, as
+ * serve_handoff(), and wait until it has saved the lists. *PORT is
+ * updated to their port. Returns the workers, one per socket, or NULL if
+ * there is no daemon. */
+static struct serve_worker *
+serve_takeover(const char *path, int *port)
+{
+        int fds[SERVE_MAX_WORKERS];
+        char control[CMSG_SPACE(sizeof fds)];
+        char byte;
+        struct iovec iov = { .iov_base = &byte, .iov_len = 1 };
+        struct msghdr msg = {
+                .msg_iov = &iov,
+                .msg_iovlen = 1,
+                .msg_control = control,
+                .msg_controllen = sizeof control,
+        };
+        struct sockaddr_in sock_in;
+        socklen_t addr_len = sizeof sock_in;
+        struct serve_worker *w;
+        struct cmsghdr *cmsg;
+        int fd;
+        int n;
 
-        /* Try to open and load CSS file directly into <style> ... </style>. */
-        fd = open(*css_file, O_RDONLY);
-        if (fd >= 0) {
-                strcatf(buf, "<style>");
-                while ((n = read(fd, css_file_buf, sizeof css_file_buf - 1)) > 0) {
-                        css_file_buf[n] = 0;
-                        strcatf(buf, "%s", css_file_buf);
-                }
+        if ((fd = control_connect(path)) < 0)
+                return NULL;
+        if (write(fd, "handoff\n", 8) != 8 || recvmsg(fd, &msg, MSG_CMSG_CLOEXEC) != 1 ||
+            (cmsg = CMSG_FIRSTHDR(&msg)) == NULL || cmsg->cmsg_type != SCM_RIGHTS) {
                 close(fd);
-                strcatf(buf, "</style>");
-        } else
-                LOG("Error: cant load css file '%s'\n", *css_file);
-
-        strcatf(buf, "</head>");
-        strcatf(buf, "<body>");
-        strcatf(buf, "<title>");
-        strcatf(buf, "Todo");
-        strcatf(buf, "</title>");
-        strcatf(buf, "<h1>");
-        strcatf(buf, "Tasks");
-        strcatf(buf, "</h1>");
-        strcatf(buf, "<dl>");
-
-        for_da_each(e, data)
-        {
-                strcatf(buf, "<dt>");
-                strcatf(buf, "%s", e->name);
-                strcatf(buf, "<form action=\"/\" method=\"GET\" style=\"display:inline;\">");
-                strcatf(buf, "<input type=\"hidden\" name=\"button\" value=\"%d\">", da_index(e, data));
-                strcatf(buf, "<button type=\"submit\">Done</button>");
-                strcatf(buf, "</form>");
-                strcatf(buf, "<dd>");
-                strcatf(buf, "%s", overload_date(e->due));
-                strcatf(buf, "</dd>");
-                if (e->desc) {
-                        strcatf(buf, "<dd><p>");
-                        strcatf(buf, "%s\n", e->desc);
-                        strcatf(buf, "</p></dd>");
-                }
-        }
-
-        strcatf(buf, "</dl>");
-        strcatf(buf, "<br>");
-        strcatf(buf, "<form action=\"/\" method=\"GET\" style=\"display:inline;\">");
-        strcatf(buf, "<input type=\"hidden\" name=\"button\" value=\"%d\">", -1);
-        strcatf(buf, "<button type=\"submit\">Save</button>");
-        strcatf(buf, "</form>");
-        strcatf(buf, "</body>");
-        strcatf(buf, "</html>");
-
-        dprintf(sdata.clientfd, "HTTP/1.1 200 OK\r\n");
-        dprintf(sdata.clientfd, "Content-Type: text/html\r\n");
-        dprintf(sdata.clientfd, "Content-Length: %zu\r\n", strlen(buf));
-        dprintf(sdata.clientfd, "\r\n");
-
-        assert(send(sdata.clientfd, buf, strlen(buf), 0) > 0);
+                return NULL;
+        }
+        n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof *fds;
+        memcpy(fds, CMSG_DATA(cmsg), sizeof *fds * n);
 
-        close(sdata.clientfd);
-        return 0;
+        w = calloc(n + 1, sizeof *w);
+        assert(w);
+        for (int i = 0; i < n; i++)
+                w[i].sockfd = fds[i];
+        w[n].sockfd = -1;
+        serve_pin_workers(w);
+        if (getsockname(fds[0], (struct sockaddr *) &sock_in, &addr_len) == 0)
+                *port = ntohs(sock_in.sin_port);
+
+        /* Connections wait in the sockets until the old daemon is done,
+         * so lists are not loaded before they are saved */
+        if (read(fd, &byte, 1) != 1)
+                fprintf(stderr, "WARNING: the old daemon exited before saving the tasks\n");
+        close(fd);
+        return w;
 }
 
-static void
-spawn_serve()
+/* Start the daemon, with the arguments ARGV. If RELOAD it takes the
+ * sockets of the running one, see serve_takeover(), and if not the
+ * running one is stopped */
+MAIN_ONLY static void
+spawn_serve(char **argv, bool reload)
 {
-        static int port = PORT;
-        struct sockaddr_in sock_in;
+        static struct serve_control control;
+        struct serve_worker *w = NULL;
         pthread_t thread_id;
-        socklen_t addr_len;
-        int sockfd;
-        int clientfd;
+        int port = *serve_port;
+        ssize_t n;
         int status;
 
+        /* Buffered output would be written by every process */
+        fflush(stdout);
+
         /* As fork is called twice it is not attacked to terminal */
         if (fork() != 0) {
                 exit(0);
@@ -378,32 +3624,35 @@ spawn_serve()
                 exit(0);
         }
 
-        kill_self();
-
-        sockfd = socket(AF_INET, SOCK_STREAM, 0);
-        assert(sockfd >= 0);
-
-        sock_in.sin_family = AF_INET;
-        sock_in.sin_addr.s_addr = htonl(INADDR_ANY);
-
-retry:
-        errno = 0;
-        sock_in.sin_port = htons(port);
+        if (reload && (w = serve_takeover(*control_socket, &port)) == NULL)
+                fprintf(stderr, "WARNING: there is no daemon to reload, starting a new one\n");
+        reload = w != NULL;
 
-        if (bind(sockfd, (struct sockaddr *) &sock_in, sizeof(struct sockaddr_in)) < 0) {
-                if (errno == EADDRINUSE) {
-                        ++port;
-                        if (port - PORT > MAX_ATTEMPTS) {
-                                perror("Bind max attempts");
-                                exit(1);
-                        }
-                        goto retry;
+        /* After a takeover the old daemon is exiting by itself */
+        if (!daemon_lock(false)) {
+                if (!reload && !control_send("stop", NULL)) {
+                        fprintf(stderr, "ERROR: another daemon holds %s and does not answer at %s\n",
+                                *pid_file, *control_socket);
+                        exit(1);
                 }
-                perror("Bind");
-                exit(1);
+                daemon_lock(true);
         }
 
-        assert(listen(sockfd, MAX_CLIENTS) >= 0);
+        if (w == NULL && (w = serve_listen_workers(INADDR_ANY, &port, *workers)) == NULL)
+                exit(1);
+
+        assert(pipe2(serve_stop, O_CLOEXEC) == 0);
+        control = (struct serve_control) {
+                .sockfd = control_listen(*control_socket),
+                .workers = w,
+                .port = port,
+                .started = time(NULL),
+                .argv = argv,
+        };
+        if ((n = readlink("/proc/self/exe", control.exe, sizeof control.exe - 1)) > 0)
+                control.exe[n] = 0;
+        else
+                strcpy(control.exe, argv[0]);
 
         /* Show the address before close descriptors so it can be redirected
          * Example: ~$ firefox $(todo -serve)
@@ -419,92 +3668,373 @@ retry:
         close(STDERR_FILENO);
 
         /* Open logfile at stdin and stdout */
-        assert(open(LOG_FILENAME, O_CREAT | O_WRONLY | O_APPEND, 0600) >= 0);
-        assert(open(LOG_FILENAME, O_CREAT | O_WRONLY | O_APPEND, 0600) >= 0);
+        assert(open(*log_file, O_CREAT | O_WRONLY | O_APPEND, 0600) >= 0);
+        assert(open(*log_file, O_CREAT | O_WRONLY | O_APPEND, 0600) >= 0);
 
-        close(STDIN_FILENO);
+        /* Not closed, or the next file opened, as the lock of -pid_file
+         * in a daemon started by reload, would be its stdin */
+        assert(dup2(open("/dev/null", O_RDONLY | O_CLOEXEC), STDIN_FILENO) == STDIN_FILENO);
 
-        while (1) {
-                addr_len = sizeof(struct sockaddr_in);
+        /* From here logging must not block request threads */
+        log_start(STDERR_FILENO);
+        LOGI("Listening on port %d%s\n", port, reload ? ", reloaded" : "");
+        reminders_start();
 
-                if (((clientfd = accept(sockfd, (struct sockaddr *) &sock_in, &addr_len)) < 0)) {
-                        LOG("accept: %s\n", strerror(errno));
-                        break;
+        if (control.sockfd >= 0) {
+                if ((status = pthread_create(&thread_id, NULL, serve_control, &control)) != 0)
+                        LOGE("pthread_create: %s\n", strerror(status));
+                else
+                        pthread_detach(thread_id);
+        }
+
+        serve_workers(w);
+
+        /* Workers only stop in a handoff, that exits the process */
+        pthread_exit(NULL);
+}
+
+static void
+destroy_all()
+{
+        store_destroy(&data);
+        lists_destroy();
+}
+
+/* Append N synthetic tasks to S, due in the next year, some of them with
+ * description, tags and priority. Used by benchmarks. */
+static void
+gen_tasks(Store *s, int n, unsigned int seed)
+{
+        time_t now = time(NULL);
+        char buf[64];
+        Task task;
+
+        for (int i = 0; i < n; i++) {
+                task = (Task) { 0 };
+                snprintf(buf, sizeof buf, "Task %d", i);
+                task.name = strdup(buf);
+                if (rand_r(&seed) % 2) {
+                        snprintf(buf, sizeof buf, "Description of task %d", i);
+                        task.desc = strdup(buf);
                 }
+                if (rand_r(&seed) % 4 == 0)
+                        task.tags = strdup(rand_r(&seed) % 2 ? "ops" : "home,ops");
+                task.prio = rand_r(&seed) % 4;
+                task.due = now + rand_r(&seed) % (365 * 24 * 3600);
+                store_add(s, task);
+        }
+}
 
-                struct serve_data sdata = (struct serve_data) {
-                        .sock_in = sock_in,
-                        .clientfd = clientfd,
-                        .addr_len = addr_len,
-                };
+enum bench_request {
+        BENCH_GET = 0,
+        BENCH_DONE,
+        BENCH_SAVE,
+        BENCH_COUNT,
+};
+
+struct bench_client {
+        int port;
+        int requests;
+        int tasks;
+        bool keep_alive;
+        int mix[BENCH_COUNT];
+        unsigned int seed;
+        Histogram *latency;
+        int count[BENCH_COUNT];
+        int errors;
+};
+
+/* Connect to 127.0.0.1:PORT. Returns the socket or -1 */
+static int
+bench_connect(int port)
+{
+        struct sockaddr_in sock_in = { 0 };
+        int one = 1;
+        int fd;
+
+        sock_in.sin_family = AF_INET;
+        sock_in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        sock_in.sin_port = htons(port);
+
+        if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+                return -1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+        if (connect(fd, (struct sockaddr *) &sock_in, sizeof sock_in) < 0) {
+                close(fd);
+                return -1;
+        }
+        return fd;
+}
+
+/* Read a whole response from FD. Returns false on error */
+static bool
+bench_read_response(int fd, char *buf, size_t size)
+{
+        const char *length;
+        size_t len = 0;
+        size_t body;
+        char *end;
+        ssize_t n;
+
+        buf[0] = 0;
+        while ((end = strstr(buf, "\r\n\r\n")) == NULL) {
+                if (len == size - 1 || (n = read(fd, buf + len, size - 1 - len)) <= 0)
+                        return false;
+                len += n;
+                buf[len] = 0;
+        }
+        if (strncmp(buf, "HTTP/1.1 200", 12) != 0)
+                return false;
+
+        end += 4;
+        if ((length = find_header(buf, "Content-Length")) == NULL)
+                return false;
+        body = strtoul(length, NULL, 10);
+
+        /* Discard body */
+        for (len -= end - buf; len < body; len += n)
+                if ((n = read(fd, buf, size)) <= 0)
+                        return false;
+        return true;
+}
+
+static void *
+bench_client_run(void *args)
+{
+        struct bench_client *c = args;
+        Todo_List *l;
+        int total = c->mix[BENCH_GET] + c->mix[BENCH_DONE] + c->mix[BENCH_SAVE];
+        size_t bufsize = 1 << 16;
+        char *buf = malloc(bufsize); /* responses are read and dropped */
+        char req[256];
+        enum bench_request type;
+        uint64_t start;
+        int fd = -1;
+        int r;
 
-                if ((status = pthread_create(&thread_id, NULL, serve_gen_response, &sdata)) != 0) {
-                        LOG("pthread_create: %s\n", strerror(status));
+        assert(buf);
+        for (int i = 0; i < c->requests; i++) {
+                r = rand_r(&c->seed) % total;
+                type = r < c->mix[BENCH_GET]                      ? BENCH_GET :
+                       r < c->mix[BENCH_GET] + c->mix[BENCH_DONE] ? BENCH_DONE :
+                                                                    BENCH_SAVE;
+
+                switch (type) {
+                case BENCH_GET:
+                        strcpy(req, "GET / HTTP/1.1\r\n");
                         break;
-                } else
-                        pthread_detach(thread_id);
+                case BENCH_DONE:
+                        snprintf(req, sizeof req, "GET /?button=%d HTTP/1.1\r\n",
+                                 (int) (rand_r(&c->seed) % (c->tasks ? c->tasks : 1)));
+                        break;
+                case BENCH_SAVE:
+                        strcpy(req, "GET /?button=-1 HTTP/1.1\r\n");
+                        break;
+                default:
+                        UNREACHABLE("bench request type");
+                }
+                strcatf(req, "Host: 127.0.0.1\r\n");
+                strcatf(req, "Accept-Encoding: gzip\r\n");
+                strcatf(req, "Connection: %s\r\n\r\n", c->keep_alive ? "keep-alive" : "close");
+
+                start = metrics_now_ns();
+                if (fd < 0 && (fd = bench_connect(c->port)) < 0) {
+                        ++c->errors;
+                        continue;
+                }
+                if (write(fd, req, strlen(req)) < 0 || !bench_read_response(fd, buf, bufsize)) {
+                        ++c->errors;
+                        close(fd);
+                        fd = -1;
+                        continue;
+                }
+                hist_record(c->latency, metrics_now_ns() - start);
+                ++c->count[type];
+
+                if (!c->keep_alive) {
+                        close(fd);
+                        fd = -1;
+                }
+
+                /* Done removes a task, add another one so the size of the
+                 * list does not change during the benchmark */
+                if (type == BENCH_DONE) {
+                        l = list_get("");
+                        list_lock(l);
+                        gen_tasks(&l->data, 1, c->seed);
+                        ++l->gen;
+                        list_unlock(l);
+                        list_put(l);
+                }
+        }
+
+        if (fd >= 0)
+                close(fd);
+        free(buf);
+        return NULL;
+}
+
+static void *
+bench_serve_loop(void *w)
+{
+        serve_workers(w);
+        return NULL;
+}
+
+/* Start the server in this process at a loopback port and measure it with
+ * CLIENTS concurrent connections doing REQUESTS requests in total. MIX are
+ * the comma separated weights of page loads, done clicks and saves. Tasks
+ * are generated, so user data is never modified. */
+MAIN_ONLY static void
+bench_serve(int clients, int requests, int tasks, bool keep_alive, const char *mix)
+{
+        static Histogram latency = HISTOGRAM("bench_latency", "", NULL);
+        char save_file[] = "/tmp/todo-bench-XXXXXX";
+        struct bench_client *c;
+        pthread_t *threads;
+        pthread_t server;
+        Hist_Shard m;
+        int count[BENCH_COUNT] = { 0 };
+        int weights[BENCH_COUNT];
+        int errors = 0;
+        struct serve_worker *w;
+        int port = 0;
+        int nworkers;
+        double elapsed;
+        uint64_t start;
+
+        if (sscanf(mix, "%d,%d,%d", &weights[BENCH_GET], &weights[BENCH_DONE], &weights[BENCH_SAVE]) != 3 ||
+            weights[BENCH_GET] < 0 || weights[BENCH_DONE] < 0 || weights[BENCH_SAVE] < 0 ||
+            weights[BENCH_GET] + weights[BENCH_DONE] + weights[BENCH_SAVE] <= 0) {
+                fprintf(stderr, "Invalid request mix: %s\n", mix);
+                exit(1);
+        }
+        if (clients <= 0 || requests <= 0) {
+                fprintf(stderr, "Invalid number of clients or requests\n");
+                exit(1);
+        }
+
+        /* Saves go to a temporary file and done tasks are not archived */
+        close(mkstemp(save_file));
+        *out_file = save_file;
+        *archive_dir = NULL;
+
+        destroy_all();
+        gen_tasks(&data, tasks, 1);
+        lists_adopt(&data);
+
+        if ((w = serve_listen_workers(INADDR_LOOPBACK, &port, *workers)) == NULL)
+                exit(1);
+        if (pthread_create(&server, NULL, bench_serve_loop, w) != 0) {
+                perror("pthread_create");
+                exit(1);
+        }
+
+        c = calloc(clients, sizeof *c);
+        threads = calloc(clients, sizeof *threads);
+        assert(c && threads);
+
+        start = metrics_now_ns();
+        for (int i = 0; i < clients; i++) {
+                c[i] = (struct bench_client) {
+                        .port = port,
+                        .requests = requests / clients + (i < requests % clients),
+                        .tasks = tasks,
+                        .keep_alive = keep_alive,
+                        .mix = { weights[0], weights[1], weights[2] },
+                        .seed = i + 1,
+                        .latency = &latency,
+                };
+                assert(pthread_create(&threads[i], NULL, bench_client_run, &c[i]) == 0);
+        }
+        for (int i = 0; i < clients; i++) {
+                pthread_join(threads[i], NULL);
+                errors += c[i].errors;
+                for (int j = 0; j < BENCH_COUNT; j++)
+                        count[j] += c[i].count[j];
         }
-        /* Really it never reaches this */
-        close(sockfd);
-        UNREACHABLE("out of daemon loop");
+        elapsed = (metrics_now_ns() - start) / 1e9;
+
+        hist_merge(&latency, &m);
+        for (nworkers = 0; w[nworkers].sockfd >= 0; nworkers++)
+                ;
+        printf("workers %d\n", nworkers);
+        printf("clients %d\n", clients);
+        printf("keep_alive %d\n", keep_alive);
+        printf("tasks %d\n", tasks);
+        printf("requests %d\n", count[BENCH_GET] + count[BENCH_DONE] + count[BENCH_SAVE]);
+        printf("requests_get %d\n", count[BENCH_GET]);
+        printf("requests_done %d\n", count[BENCH_DONE]);
+        printf("requests_save %d\n", count[BENCH_SAVE]);
+        printf("errors %d\n", errors);
+        printf("elapsed_s %.6f\n", elapsed);
+        printf("throughput_rps %.1f\n", (requests - errors) / elapsed);
+        printf("latency_p50_us %.1f\n", hist_quantile(&m, 0.50) / 1e3);
+        printf("latency_p99_us %.1f\n", hist_quantile(&m, 0.99) / 1e3);
+        printf("latency_p999_us %.1f\n", hist_quantile(&m, 0.999) / 1e3);
+
+        unlink(save_file);
+        free(c);
+        free(threads);
+        /* The server thread never returns */
+        exit(errors != 0);
 }
 
 static time_t
 days(unsigned int days)
 {
         time_t t;
-        struct tm *tp = { 0 };
+        struct tm tp;
         t = time(NULL) + days * (3600 * 24);
-        tp = localtime(&t);
-        tp->tm_hour = 23;
-        tp->tm_min = 59;
-        tp->tm_sec = 59;
-        tp->tm_isdst = -1; // determine if summer time is in use (+-1h)
-        return mktime(tp);
+        tz_localtime(&t, &tp);
+        tp.tm_hour = 23;
+        tp.tm_min = 59;
+        tp.tm_sec = 59;
+        tp.tm_isdst = -1; // determine if summer time is in use (+-1h)
+        return tz_mktime(&tp);
 }
 
-static time_t
+MAIN_ONLY static time_t
 next_sunday(int *d)
 {
         time_t t;
-        struct tm *tp;
+        struct tm tp;
         t = time(NULL);
-        tp = localtime(&t);
-        tp->tm_isdst = -1; // determine if summer time is in use (+-1h)
-        mktime(tp);
+        tz_localtime(&t, &tp);
         if (d)
-                *d = 7 - tp->tm_wday;
-        return days(7 - tp->tm_wday);
+                *d = 7 - tp.tm_wday;
+        return days(7 - tp.tm_wday);
 }
 
-/* Get a subarray of DATA whose end date is before TP */
-static Task_da
-tasks_before(struct tm tp)
+/* Get the rows of DATA whose end date is between FROM and TO, both
+ * included */
+static Row_da
+tasks_between(Store *s, time_t from, time_t to)
 {
-        tp.tm_isdst = -1; // determine if summer time is in use (+-1h)
-        time_t time = mktime(&tp);
-        Task_da filtered_data = { 0 };
+        Row_da filtered_data = { 0 };
+        uint64_t *mask;
+        uint64_t m;
 
-        for_da_each(task, data)
-        {
-                if (difftime(task->due, time) <= 0)
-                        da_append(&filtered_data, *task);
+        mask = malloc(sizeof *mask * (RANGE_WORDS(s->size) + 1));
+        assert(mask);
+        range_select(s->due, s->size, from, to, mask);
+        for (int w = 0; w < RANGE_WORDS(s->size); w++) {
+                for (m = mask[w]; m; m &= m - 1)
+                        da_append(&filtered_data, w * 64 + __builtin_ctzll(m));
         }
+        free(mask);
         return filtered_data;
 }
 
-static void
-destroy_all()
+/* Get the rows of DATA whose end date is before TP */
+static Row_da
+tasks_before(Store *s, struct tm tp)
 {
-        for_da_each(e, data)
-        {
-                free(e->name);
-                free(e->desc);
-        }
-        da_destroy(&data);
+        tp.tm_isdst = -1; // determine if summer time is in use (+-1h)
+        return tasks_between(s, RANGE_TIME_MIN, tz_mktime(&tp));
 }
 
-static void
+MAIN_ONLY static void
 usage(FILE *stream)
 {
         fprintf(stream, "Usage: %s [OPTIONS]\n", flag_program_name());
@@ -512,14 +4042,20 @@ usage(FILE *stream)
         flag_print_options(stream);
 }
 
-static void
-add_task()
+/* Ask for the name, description, date and time of a task and add it */
+MAIN_ONLY static void
+add_task(Store *s, const char *tags, int prio, const char *repeat)
 {
-        Task task = { 0 };
+        Task task = {
+                .prio = prio,
+                .tags = tags ? strdup(tags) : NULL,
+                .repeat = repeat ? strdup(repeat) : NULL,
+        };
+        const char *error;
         char buf[128];
-        time_t t = time(0);
-        struct tm tp_current = *localtime(&t);
-        struct tm tp = { 0 };
+        struct tm tp_current;
+        struct tm tp;
+        time_t t;
         int n;
 
         /* Name */
@@ -544,32 +4080,20 @@ add_task()
         printf("  | DD: Day DD of current month\n");
         printf("  | DD/MM: Day DD of MM month\n");
         printf("  | DD/MM/YYYY: Day DD of MM month of year YY\n");
+        printf("  | Or as -due: fri, next mon, +2w, 2026-11-01, tomorrow 9am\n");
         printf("  Date format: ");
         fflush(stdout);
         fgets(buf, sizeof buf - 1, stdin);
 
-        if (sscanf(buf, "+%d", &n) == 1) {
-                t += n * (3600 * 24);
-                tp = *localtime(&t);
-
-        } else if (sscanf(buf, "%d/%d/%d", &tp.tm_mday, &tp.tm_mon, &tp.tm_year) == 3) {
-                tp.tm_year -= 1900;
-                --tp.tm_mon;
-
-        } else if (sscanf(buf, "%d/%d", &tp.tm_mday, &tp.tm_mon) == 2) {
-                tp.tm_year = tp_current.tm_year;
-                --tp.tm_mon;
-
-        } else if (sscanf(buf, "%d", &tp.tm_mday) == 1) {
-                tp.tm_year = tp_current.tm_year;
-                tp.tm_mon = tp_current.tm_mon;
-
-        } else {
-                LOG("Error: can not parse date: %s\n", buf);
+        if ((t = date_parse(buf, time(NULL), &error)) == -1) {
+                LOGE("Can not parse date: %s: %s\n", buf, error);
                 free(task.name);
                 free(task.desc);
+                free(task.tags);
+                free(task.repeat);
                 return;
         }
+        tz_localtime(&t, &tp);
 
         /* Time */
         printf("  | +N: N hours from now\n");
@@ -579,118 +4103,469 @@ add_task()
         fflush(stdout);
         fgets(buf, sizeof buf - 1, stdin);
         if (sscanf(buf, "+%d", &n) == 1) {
-                struct tm tp2;
-                t = time(NULL) + n * (3600 * 24);
-                tp2 = *localtime(&t);
-                tp.tm_hour = tp2.tm_hour + n;
-                tp.tm_min = tp2.tm_min;
-                tp.tm_sec = tp2.tm_sec;
+                /* The time of day N hours from now, at the given date */
+                t = time(NULL);
+                tz_localtime(&t, &tp_current);
+                tp.tm_hour = tp_current.tm_hour + n;
+                tp.tm_min = tp_current.tm_min;
+                tp.tm_sec = tp_current.tm_sec;
         } else if (sscanf(buf, "%d %d", &tp.tm_hour, &tp.tm_min) == 2) {
                 tp.tm_sec = 0;
-        } else {
-                tp.tm_hour = 23;
-                tp.tm_min = 59;
-                tp.tm_sec = 59;
         }
+        /* Else the time of the date, that defaults to 23:59:59 */
 
         tp.tm_isdst = -1; // determine if summer time is in use (+-1h)
-        task.due = mktime(&tp);
+        task.due = tz_mktime(&tp);
+
+        store_add(s, task);
+}
+
+/* Add the task NAME due at DUE without asking, for scripts */
+MAIN_ONLY static void
+add_task_now(Store *s, const char *name, time_t due, const char *desc,
+             const char *tags, int prio, const char *repeat)
+{
+        store_add(s, (Task) {
+                             .name = strdup_line(name),
+                             .due = due,
+                             .desc = strdup_line(desc),
+                             .tags = strdup_line(tags),
+                             .repeat = strdup_line(repeat),
+                             .prio = prio,
+                     });
+        if (!*quiet)
+                printf("Added: %s (%s)\n", name, overload_date(due));
+}
+
+/* bench.c includes this file to reach static functions */
+#ifndef TODO_NO_MAIN
+/* Time spent by a command in each phase, shown with -timing */
+enum timing_phase {
+        TIMING_FLAGS = 0,
+        TIMING_LOAD,
+        TIMING_QUERY,
+        TIMING_RENDER,
+        TIMING_SAVE,
+        TIMING_COUNT,
+};
+
+static const char *timing_names[TIMING_COUNT] = {
+        [TIMING_FLAGS] = "flags",
+        [TIMING_LOAD] = "load",
+        [TIMING_QUERY] = "query",
+        [TIMING_RENDER] = "render",
+        [TIMING_SAVE] = "save",
+};
+
+static uint64_t timing_ns[TIMING_COUNT];
+
+#define TIMED(phase, ...)                                    \
+        do {                                                 \
+                uint64_t _t0_ = metrics_now_ns();            \
+                __VA_ARGS__;                                 \
+                timing_ns[phase] += metrics_now_ns() - _t0_; \
+        } while (0)
+
+/* The command line loads DATA the first time a command needs it. Commands
+ * that change it set DATA_CHANGED, so it is saved */
+static bool data_loaded = false;
+static bool data_changed = false;
+
+static Store *
+load_data()
+{
+        if (!data_loaded) {
+                data.archive.dir = *archive_dir;
+                TIMED(TIMING_LOAD, load_from_file(&data, *in_file));
+                data_loaded = true;
+        }
+        return &data;
+}
+
+/* Append the task NAME to FILENAME, as add_task_now(), without loading
+ * the tasks of the file */
+static void
+append_task(const char *filename, const char *name, time_t due, const char *desc,
+            const char *tags, int prio, const char *repeat)
+{
+        Store s = { 0 };
+        struct summary sum;
+        time_t now = time(NULL);
+        bool counted;
+        FILE *f;
 
-        da_append(&data, task);
+        /* The summary has to be read before the file changes */
+        counted = summary_read(&sum, filename, now);
+        add_task_now(&s, name, due, desc, tags, prio, repeat);
+        if ((f = fopen(filename, "a")) == NULL)
+                LOGE("File %s can not be opened to write!\n", filename);
+        else {
+                write_task(&s, f, 0);
+                fprintf(f, "\n");
+                fclose(f);
+                if (counted) {
+                        summary_add(&sum, due, repeat, now);
+                        summary_save(&sum, filename);
+                }
+        }
+        store_destroy(&s);
 }
 
+/* NAME in the home directory, as the paths of options.h. Absolute paths
+ * are returned as they are */
+static char *
+home_path(const char *name)
+{
+        const char *home = getenv("HOME");
+        char *path;
+        size_t size;
+
+        if (home == NULL || *name == '/')
+                return strdup(name);
+        size = strlen(home) + strlen(name) + 2;
+        path = malloc(size);
+        assert(path);
+        snprintf(path, size, "%s/%s", home, name);
+        return path;
+}
 
 int
 main(int argc, char *argv[])
 {
+        uint64_t start = metrics_now_ns();
         bool *help = flag_bool("help", false, "Print this help and exit");
         bool *today = flag_bool("today", false, "Show tasks due today");
         bool *week = flag_bool("week", false, "Show tasks due this week (tasks before Sunday)");
         int *in = flag_int("in", -1, "Show tasks due in the next N days");
         bool *overdue = flag_bool("overdue", false, "Show tasks that are past their due date");
+        bool *summary = flag_bool("summary", false, "Show the number of overdue tasks and tasks due today, for shell prompts");
+        char **query = flag_str("query", NULL, "Show tasks matching a query, as: due<+7d and tag:ops and prio>=2");
+        char **search_query = flag_str("search", NULL, "Show tasks with words starting with every word of the query (*word: containing it)");
         int *done = flag_int("done", -1, "Mark task N as completed");
         bool *clear = flag_bool("clear", false, "Mark all tasks as completed");
-        bool *add = flag_bool("add", false, "Add a new task");
-        char **in_file = flag_str("in_file", IN_FILENAME, "Input file");
-        out_file = flag_str("out_file", IN_FILENAME, "Output file");
-        css_file = flag_str("css_file", CSS_FILENAME, "CSS file");
+        char **add = flag_str("add", NULL, "Add a task named NAME, or ask for it if NAME is -");
+        char **due = flag_str("due", "today", "Due date of the task added with -add NAME, as: fri 17:00, +3d, next mon, 2026-11-01 9am");
+        char **desc = flag_str("desc", NULL, "Description of the task added with -add NAME");
+        char **tags = flag_str("tags", NULL, "Comma separated tags of the task added with -add");
+        int *prio = flag_int("prio", 0, "Priority of the task added with -add");
+        int *history = flag_int("history", -1, "Show tasks done in the last N days");
+        char **import_file = flag_str("import", NULL, "Add the tasks of a file, - for stdin");
+        char **export_file = flag_str("export", NULL, "Write all tasks to a file, - for stdout");
+        char **format = flag_str("format", NULL, "Format of -import and -export: csv, ndjson or ics. Defaults to the file extension, or csv");
+        char **repeat = flag_str("repeat", NULL, "Recurrence of the task added with -add, as: daily, every 2 weeks, monthly on 1, cron 0 9 * * 1-5");
+        in_file = flag_setting(flag_str("in_file", home_path(IN_FILENAME), "Input file"));
+        out_file = flag_setting(flag_str("out_file", home_path(OUT_FILENAME), "Output file"));
+        archive_dir = flag_setting(flag_str("archive_dir", home_path(ARCHIVE_PATH), "Directory of the archive of done tasks"));
+        char **list = flag_str("list", NULL, "Use the list NAME of -lists_dir instead of -in_file and -out_file");
+        lists_dir = flag_setting(flag_str("lists_dir", home_path(LISTS_PATH), "Directory of the named lists, served at /list/NAME"));
+        max_lists = flag_setting(flag_int("max_lists", MAX_LISTS, "Lists loaded at once by the daemon"));
+        assets_dir = flag_setting(flag_str("assets_dir", home_path(ASSETS_PATH), "Directory of the files served at /assets/, as " CSS_FILENAME " and favicon.ico"));
+        max_connections = flag_setting(flag_int("max_connections", MAX_CONNECTIONS, "Connections served at once by the daemon, the next ones get 503"));
+        read_timeout = flag_setting(flag_int("read_timeout", READ_TIMEOUT, "Milliseconds a client has to send a request"));
+        write_timeout = flag_setting(flag_int("write_timeout", WRITE_TIMEOUT, "Milliseconds a client has to read a response"));
+        workers = flag_setting(flag_int("workers", WORKERS, "Accept threads of the daemon, each pinned to a cpu. 0 for one per cpu"));
+        remind_before = flag_setting(flag_int("remind_before", REMIND_BEFORE, "Minutes before tasks are due the daemon reminds them"));
+        remind_exec = flag_setting(flag_str("remind_exec", NULL, "Command the daemon runs with sh to remind a task, with TASK_NAME, TASK_DUE and TASK_LIST set"));
+        remind_fifo = flag_setting(flag_str("remind_fifo", NULL, "Fifo or file where the daemon writes a line per reminder: due, list and name, tab separated"));
+        assets_max_age = flag_setting(flag_int("assets_max_age", ASSETS_MAX_AGE, "Seconds browsers can cache assets without asking again"));
+        log_file = flag_setting(flag_str("log_file", home_path(LOG_FILENAME), "Log file of the daemon"));
+        pid_file = flag_setting(flag_str("pid_file", PID_FILENAME, "File with the pid of the daemon"));
+        control_socket = flag_setting(flag_str("socket", SOCKET_FILENAME, "Unix socket of the daemon, used by -reload, -ctl and -die"));
+        datetime_format = flag_setting(flag_str("datetime_format", DATETIME_FORMAT, "strftime(3) format of the dates of the task file"));
+        serve_port = flag_setting(flag_int("port", PORT, "Port of the http server"));
+        max_attempts = flag_setting(flag_int("max_attempts", MAX_ATTEMPTS, "Next ports tried if -port is in use"));
+        max_clients = flag_setting(flag_int("max_clients", MAX_CLIENTS, "Connections waiting to be accepted by the daemon"));
+        bufsize = flag_setting(flag_size("bufsize", BUFSIZE, "IO buffer size, as 1M. Request heads can use 1/64 of it"));
+        char *default_config = home_path(CONFIG_FILENAME);
+        char **config = flag_setting(flag_str("config", default_config, "Config file, with a flag per line, as: port = 5003"));
         bool *serve = flag_bool("serve", false, "Start http server daemon");
-        bool *die = flag_bool("die", false, "Kill running daemon");
-        quiet = flag_bool("quiet", false, "Do not show unneded output");
+        bool *reload = flag_bool("reload", false, "Start a daemon that takes the port of the running one, that finishes its requests, saves and exits");
+        bool *die = flag_bool("die", false, "Stop the running daemon, that finishes its requests and saves");
+        char **ctl = flag_str("ctl", NULL, "Send a command to the daemon: status, stats, flush, reload or stop");
+        quiet = flag_setting(flag_bool("quiet", false, "Do not show unneded output"));
+        char **log_level_str = flag_setting(flag_str("log_level", "error", "Log level: none, error, warn, info or debug"));
+        bool *bench = flag_bool("bench_serve", false, "Benchmark the http server in this process with generated tasks");
+        int *bench_clients = flag_int("bench_clients", 8, "Concurrent clients for -bench_serve");
+        int *bench_requests = flag_int("bench_requests", 10000, "Requests done by -bench_serve");
+        int *bench_tasks = flag_int("bench_tasks", 100, "Tasks generated for -bench_serve");
+        bool *bench_keep_alive = flag_bool("bench_keep_alive", false, "Reuse connections in -bench_serve");
+        char **bench_mix = flag_str("bench_mix", "90,9,1", "Weights of page loads, done clicks and saves in -bench_serve");
+
+        bool *timing = flag_bool("timing", false, "Show the time spent loading, querying, printing and saving tasks");
+        time_t due_time = 0;
 
         srand(time(0));
 
-        if (!flag_parse(argc, argv)) {
+        /* The command line overrides the environment, that overrides the
+         * config file. A missing config file is only an error if it was
+         * given */
+        if (!flag_parse(argc, argv) || !flag_parse_env(ENV_PREFIX) ||
+            ((*config != default_config || access(*config, F_OK) == 0) &&
+             !flag_parse_file(*config))) {
                 usage(stderr);
                 flag_print_error(stderr);
                 exit(1);
         }
 
-        load_from_file(*in_file);
+        if (*serve_port < 0 || *serve_port > 65535) {
+                usage(stderr);
+                fprintf(stderr, "ERROR: -%s: invalid port\n", flag_name(serve_port));
+                exit(1);
+        }
+
+        if (*bufsize < 64 * 1024) {
+                usage(stderr);
+                fprintf(stderr, "ERROR: -%s: it has to be at least 64K\n", flag_name(bufsize));
+                exit(1);
+        }
+
+        if (log_level_from_str(*log_level_str) < 0) {
+                usage(stderr);
+                fprintf(stderr, "ERROR: -%s: invalid log level\n", flag_name(log_level_str));
+                exit(1);
+        }
+        log_set_level(log_level_from_str(*log_level_str));
+
+        if (*repeat) {
+                const char *error;
+                Recur r;
+                if (recur_parse(&r, *repeat, &error)) {
+                        usage(stderr);
+                        fprintf(stderr, "ERROR: -%s: %s\n", flag_name(repeat), error);
+                        exit(1);
+                }
+        }
+
+        if (*add && strcmp(*add, "-")) {
+                const char *error;
+                if (**add == 0) {
+                        usage(stderr);
+                        fprintf(stderr, "ERROR: -%s: empty task name\n", flag_name(add));
+                        exit(1);
+                }
+                if ((due_time = date_parse(*due, time(NULL), &error)) == -1) {
+                        usage(stderr);
+                        fprintf(stderr, "ERROR: -%s: %s\n", flag_name(due), error);
+                        exit(1);
+                }
+        }
+
+        if (*format && task_format(*format, "") < 0) {
+                usage(stderr);
+                fprintf(stderr, "ERROR: -%s: unknown format %s\n", flag_name(format), *format);
+                exit(1);
+        }
+
+        if (*query) {
+                const char *error;
+                Query q;
+                if (query_compile(&q, *query, time(NULL), &error)) {
+                        usage(stderr);
+                        fprintf(stderr, "ERROR: -%s: %s\n", flag_name(query), error);
+                        exit(1);
+                }
+                query_destroy(&q);
+        }
+
+        if (*list) {
+                static char list_file[PATH_MAX];
+                static char list_archive[PATH_MAX];
+                static char *list_file_ptr = list_file;
+                static char *list_archive_ptr = list_archive;
+                if (!list_name_valid(*list)) {
+                        usage(stderr);
+                        fprintf(stderr, "ERROR: -%s: names can only have letters, digits, '_' and '-'\n", flag_name(list));
+                        exit(1);
+                }
+                mkdir(*lists_dir, 0755);
+                snprintf(list_file, sizeof list_file, "%s/%s.out", *lists_dir, *list);
+                snprintf(list_archive, sizeof list_archive, "%s/%s.archive", *lists_dir, *list);
+                in_file = out_file = &list_file_ptr;
+                archive_dir = &list_archive_ptr;
+        }
+
+        timing_ns[TIMING_FLAGS] = metrics_now_ns() - start;
 
-        /* The if(...) without else show tasks list.
+        /* Tasks are only loaded by the commands that need them, see
+         * load_data(). The if(...) without else show tasks list.
          * The if(...) with else do not show default list tasks */
 
         if (*help) {
                 usage(stdout);
-                destroy_all();
                 exit(0);
         }
 
-        if (*add) {
-                add_task();
+        if (*add && !strcmp(*add, "-")) {
+                add_task(load_data(), *tags, *prio, *repeat);
+                data_changed = true;
+        } else if (*add && !data_loaded && !strcmp(*in_file, *out_file)) {
+                /* Nothing else was loaded: append the task instead of
+                 * rewriting the file */
+                TIMED(TIMING_SAVE, append_task(*out_file, *add, due_time, *desc, *tags, *prio, *repeat));
+        } else if (*add) {
+                add_task_now(load_data(), *add, due_time, *desc, *tags, *prio, *repeat);
+                data_changed = true;
+        }
+
+        if (*import_file) {
+                import_tasks(load_data(), *import_file, task_format(*format, *import_file));
+                data_changed = true;
         }
 
         if (*done >= 0) {
-                qsort(data.data, data.size, sizeof *data.data, compare_tasks_by_date);
-                da_remove(&data, *done);
+                store_sort(load_data());
+                data_changed |= store_complete(&data, *done);
         }
 
         if (*clear) {
-                data.size = 0;
+                load_data();
+                for (int row = 0; row < data.size; row++)
+                        archive_add(&data, row, time(NULL));
+                store_clear(&data);
+                data_changed = true;
         }
 
-        if (*overdue) {
+        if (*summary) {
+                /* Read from the summary file if it is up to date */
+                struct summary sum;
+                time_t now = time(NULL);
+                bool fresh = false;
+                if (!data_loaded)
+                        TIMED(TIMING_QUERY, fresh = summary_read(&sum, *in_file, now));
+                if (!fresh) {
+                        load_data();
+                        TIMED(TIMING_QUERY, summary_count(&data, now, &sum));
+                        /* Changed tasks write it when they are saved */
+                        if (!data_changed)
+                                summary_save(&sum, *in_file);
+                }
+                if (*quiet)
+                        printf("%d %d\n", sum.overdue, sum.today);
+                else {
+                        printf("Overdue: %d, today: %d", sum.overdue, sum.today);
+                        if (sum.next_due != -1)
+                                printf(", next: %s", overload_date(sum.next_due));
+                        printf("\n");
+                }
+        }
+
+        else if (*overdue) {
                 time_t t = time(NULL);
-                Task_da filter = tasks_before(*localtime(&t));
-                list_tasks(STDOUT_FILENO, filter, "Overdue tasks");
+                struct tm tm;
+                Row_da filter;
+                load_data();
+                TIMED(TIMING_QUERY, filter = tasks_before(&data, *tz_localtime(&t, &tm)));
+                TIMED(TIMING_RENDER, list_tasks(&data, STDOUT_FILENO, filter, t, "Overdue tasks"));
+                da_destroy(&filter);
+        }
+
+        else if (*query) {
+                const char *error;
+                Row_da filter;
+                load_data();
+                TIMED(TIMING_QUERY, filter = tasks_where(&data, *query, &error));
+                if (error)
+                        fprintf(stderr, "ERROR: -%s: %s\n", flag_name(query), error);
+                else
+                        TIMED(TIMING_RENDER, list_tasks(&data, STDOUT_FILENO, filter, RANGE_TIME_MIN, "Tasks where %s", *query));
+                da_destroy(&filter);
+        }
+
+        else if (*export_file) {
+                TIMED(TIMING_RENDER, export_tasks(load_data(), *export_file, task_format(*format, *export_file)));
+        }
+
+        else if (*history >= 0) {
+                TIMED(TIMING_RENDER, list_history(STDOUT_FILENO, *archive_dir, *history));
+        }
+
+        else if (*search_query) {
+                Row_da filter;
+                load_data();
+                TIMED(TIMING_QUERY, filter = tasks_matching(&data, *search_query));
+                TIMED(TIMING_RENDER, list_tasks(&data, STDOUT_FILENO, filter, RANGE_TIME_MIN, "Tasks matching \"%s\"", *search_query));
                 da_destroy(&filter);
         }
 
         else if (*today) {
                 time_t time = days(0);
-                Task_da filter = tasks_before(*localtime(&time));
-                list_tasks(STDOUT_FILENO, filter, "Tasks for today");
+                struct tm tm;
+                Row_da filter;
+                load_data();
+                TIMED(TIMING_QUERY, filter = tasks_before(&data, *tz_localtime(&time, &tm)));
+                TIMED(TIMING_RENDER, list_tasks(&data, STDOUT_FILENO, filter, time, "Tasks for today"));
+                da_destroy(&filter);
         }
 
         else if (*in >= 0) {
                 time_t time = days(*in);
-                Task_da filter = tasks_before(*localtime(&time));
-                list_tasks(STDOUT_FILENO, filter, "Tasks for %d days", *in);
+                struct tm tm;
+                Row_da filter;
+                load_data();
+                TIMED(TIMING_QUERY, filter = tasks_before(&data, *tz_localtime(&time, &tm)));
+                TIMED(TIMING_RENDER, list_tasks(&data, STDOUT_FILENO, filter, time, "Tasks for %d days", *in));
                 da_destroy(&filter);
         }
 
         else if (*week) {
                 time_t t = next_sunday(NULL);
-                Task_da filter = tasks_before(*localtime(&t));
-                list_tasks(STDOUT_FILENO, filter, "Tasks before Sunday");
+                struct tm tm;
+                Row_da filter;
+                load_data();
+                TIMED(TIMING_QUERY, filter = tasks_before(&data, *tz_localtime(&t, &tm)));
+                TIMED(TIMING_RENDER, list_tasks(&data, STDOUT_FILENO, filter, t, "Tasks before Sunday"));
                 da_destroy(&filter);
         }
 
-        else if (*serve) {
-                spawn_serve();
+        else if (*serve || *reload) {
+                /* The daemon loads the saved tasks when it needs them */
+                if (data_changed)
+                        load_to_file(&data, *out_file);
+                spawn_serve(argv, *reload);
+        }
+
+        else if (*bench) {
+                bench_serve(*bench_clients, *bench_requests, *bench_tasks,
+                            *bench_keep_alive, *bench_mix);
         }
 
         else if (*die) {
-                kill_self();
-                sem_unlink("/todo_pid_file_sem");
+                control_send("stop", NULL);
+        }
+
+        else if (*ctl) {
+                if (!control_send(*ctl, stdout)) {
+                        fprintf(stderr, "ERROR: no daemon at %s\n", *control_socket);
+                        exit(1);
+                }
+        }
+
+        else if (*import_file || (*add && strcmp(*add, "-"))) {
+                /* Do not list what was added */
         }
 
         else {
-                list_tasks(STDOUT_FILENO, data, "Tasks");
+                /* Only the pending occurrence of recurring tasks, so the
+                 * index can be used with -done */
+                Row_da all;
+                load_data();
+                TIMED(TIMING_QUERY, store_sort(&data); all = store_rows(&data));
+                TIMED(TIMING_RENDER, list_tasks(&data, STDOUT_FILENO, all, RANGE_TIME_MIN, "Tasks"));
+                da_destroy(&all);
         }
 
-        load_to_file(*out_file);
+        /* Reading to -in_file and writing to another -out_file copies the
+         * tasks, even if they did not change */
+        if (data_loaded && (data_changed || strcmp(*in_file, *out_file)))
+                TIMED(TIMING_SAVE, load_to_file(&data, *out_file));
         destroy_all();
+
+        if (*timing) {
+                fprintf(stderr, "timing:");
+                for (int i = 0; i < TIMING_COUNT; i++)
+                        fprintf(stderr, " %s %.3fms", timing_names[i], timing_ns[i] / 1e6);
+                fprintf(stderr, " total %.3fms\n", (metrics_now_ns() - start) / 1e6);
+        }
         return 0;
 }
+#endif // TODO_NO_MAIN
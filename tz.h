@@ -0,0 +1,298 @@
+#ifndef TZ_H_
+#define TZ_H_
+
+/* tz.h -- cached local time zone
+ *
+ * Author: Hugo Coto Florez
+ * Repo: https://github.com/hugootoflorez/todo
+ * License: licenseless
+ *
+ * tz_localtime() and tz_mktime() work as localtime_r() and mktime(), but
+ * without the lock the C library takes and the TZ check it does in each
+ * call. The first call asks localtime_r() the UTC offset of each day from
+ * TZ_YEARS years before now to TZ_YEARS years after, and keeps the times
+ * where it changes. Later calls find the offset with a binary search over
+ * them, and compute the date from the days since the epoch. The table is
+ * never modified once built, so calls from many threads do not wait for
+ * each other.
+ *
+ * Times out of the table, local times skipped or repeated by a change of
+ * the offset and tm_isdst hints that do not match are left to the C
+ * library, so results are always the same as its. Changes of TZ or of the
+ * zone files after the first call are not seen, and offsets that change
+ * and change back in the same day are missed.
+ *
+ * Usage:
+ *   struct tm tm;
+ *   tz_localtime(&t, &tm);
+ *   tm.tm_mday += 7;
+ *   t = tz_mktime(&tm);
+ */
+
+#include <time.h>
+
+/* Years before and after the first call in the table */
+#ifndef TZ_YEARS
+#define TZ_YEARS 10
+#endif
+
+/* As localtime_r(). Returns TM, or NULL on error */
+struct tm *tz_localtime(const time_t *t, struct tm *tm);
+/* As mktime(): TM is normalized and its tm_wday, tm_yday and tm_isdst
+ * are set. Returns the time, or -1 on error */
+time_t tz_mktime(struct tm *tm);
+/* As timegm(): the time of TM as UTC. TM is not modified */
+time_t tz_timegm(const struct tm *tm);
+
+#endif // TZ_H_
+
+#ifdef TZ_IMPLEMENTATION
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+/* Seconds of a day. The zone is probed once a day */
+#define TZ_DAY 86400
+
+/* From AT on, the offset is GMTOFF */
+typedef struct {
+        time_t at;
+        long gmtoff;
+        int isdst;
+        const char *zone;
+} Tz_Span;
+
+/* Spans of the times in [FROM, TO) */
+typedef struct {
+        time_t from;
+        time_t to;
+        int count;
+        Tz_Span spans[];
+} Tz_Table;
+
+static Tz_Table *tz_cache = NULL;
+
+/* Days from civil, http://howardhinnant.github.io/date_algorithms.html.
+ * MON is in [0, 11] */
+static long long
+tz_days_from_civil(long long y, int mon, int mday)
+{
+        y -= mon < 2;
+        long long era = (y >= 0 ? y : y - 399) / 400;
+        long long yoe = y - era * 400;
+        long long doy = (153 * (mon + (mon < 2 ? 10 : -2)) + 2) / 5 + mday - 1;
+        long long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return era * 146097 + doe - 719468;
+}
+
+/* Fill the date of TM with the day DAYS since the epoch */
+static void
+tz_civil_from_days(long long days, struct tm *tm)
+{
+        long long z = days + 719468;
+        long long era = (z >= 0 ? z : z - 146096) / 146097;
+        long long doe = z - era * 146097;
+        long long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        long long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        long long mp = (5 * doy + 2) / 153;
+        int mon = mp < 10 ? mp + 2 : mp - 10;
+        long long y = yoe + era * 400 + (mon < 2);
+
+        tm->tm_year = y - 1900;
+        tm->tm_mon = mon;
+        tm->tm_mday = doy - (153 * mp + 2) / 5 + 1;
+        tm->tm_wday = ((days + 4) % 7 + 7) % 7; /* 1970-01-01 was thursday */
+        tm->tm_yday = days - tz_days_from_civil(y, 0, 1);
+}
+
+static bool
+tz_same(const struct tm *a, const struct tm *b)
+{
+        return a->tm_gmtoff == b->tm_gmtoff && a->tm_isdst == b->tm_isdst;
+}
+
+static Tz_Table *
+tz_build(time_t now)
+{
+        time_t from = now - TZ_YEARS * 366L * TZ_DAY;
+        time_t to = now + TZ_YEARS * 366L * TZ_DAY;
+        int cap = 16;
+        Tz_Table *t;
+        Tz_Table *bigger;
+        struct tm prev;
+        struct tm tm;
+        time_t lo, hi, mid;
+
+        if ((t = malloc(sizeof *t + cap * sizeof *t->spans)) == NULL)
+                return NULL;
+        t->from = from;
+        t->to = to;
+        t->count = 0;
+
+        if (localtime_r(&from, &prev) == NULL) {
+                free(t);
+                return NULL;
+        }
+        t->spans[t->count++] = (Tz_Span) { from, prev.tm_gmtoff, prev.tm_isdst, prev.tm_zone };
+
+        for (time_t day = from + TZ_DAY; day < to + TZ_DAY; day += TZ_DAY) {
+                if (localtime_r(&day, &tm) == NULL) {
+                        free(t);
+                        return NULL;
+                }
+                if (tz_same(&tm, &prev))
+                        continue;
+
+                /* The first second of the new offset is in (day - 1d, day] */
+                lo = day - TZ_DAY;
+                hi = day;
+                while (hi - lo > 1) {
+                        mid = lo + (hi - lo) / 2;
+                        if (localtime_r(&mid, &prev) && tz_same(&prev, &tm))
+                                hi = mid;
+                        else
+                                lo = mid;
+                }
+
+                if (t->count == cap) {
+                        cap *= 2;
+                        if ((bigger = realloc(t, sizeof *t + cap * sizeof *t->spans)) == NULL) {
+                                free(t);
+                                return NULL;
+                        }
+                        t = bigger;
+                }
+                t->spans[t->count++] = (Tz_Span) { hi, tm.tm_gmtoff, tm.tm_isdst, tm.tm_zone };
+                prev = tm;
+        }
+        return t;
+}
+
+/* The table, built by the first caller. Threads that build it at the
+ * same time keep the first one published */
+static Tz_Table *
+tz_table(void)
+{
+        Tz_Table *t = __atomic_load_n(&tz_cache, __ATOMIC_ACQUIRE);
+        Tz_Table *expected = NULL;
+
+        if (t)
+                return t;
+        if ((t = tz_build(time(NULL))) == NULL)
+                return NULL;
+        if (!__atomic_compare_exchange_n(&tz_cache, &expected, t, false,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                free(t);
+                t = expected;
+        }
+        return t;
+}
+
+/* Index of the span of T, that has to be in the table */
+static int
+tz_find(const Tz_Table *tz, time_t t)
+{
+        int lo = 0;
+        int hi = tz->count - 1;
+        int mid;
+
+        while (lo < hi) {
+                mid = (lo + hi + 1) / 2;
+                if (tz->spans[mid].at <= t)
+                        lo = mid;
+                else
+                        hi = mid - 1;
+        }
+        return lo;
+}
+
+struct tm *
+tz_localtime(const time_t *t, struct tm *tm)
+{
+        const Tz_Table *tz = tz_table();
+        const Tz_Span *s;
+        long long local;
+        long long days;
+        long long secs;
+
+        if (tz == NULL || *t < tz->from || *t >= tz->to)
+                return localtime_r(t, tm);
+
+        s = &tz->spans[tz_find(tz, *t)];
+        local = (long long) *t + s->gmtoff;
+        days = (local >= 0 ? local : local - (TZ_DAY - 1)) / TZ_DAY;
+        secs = local - days * TZ_DAY;
+
+        tz_civil_from_days(days, tm);
+        tm->tm_hour = secs / 3600;
+        tm->tm_min = secs / 60 % 60;
+        tm->tm_sec = secs % 60;
+        tm->tm_isdst = s->isdst;
+        tm->tm_gmtoff = s->gmtoff;
+        tm->tm_zone = s->zone;
+        return tm;
+}
+
+/* Seconds of the local time of TM since the epoch, as if it was UTC.
+ * Out of range months are carried to the year, the rest add up */
+static long long
+tz_local_seconds(const struct tm *tm)
+{
+        long long y = tm->tm_year + 1900LL + tm->tm_mon / 12;
+        int mon = tm->tm_mon % 12;
+
+        if (mon < 0) {
+                mon += 12;
+                --y;
+        }
+        return (tz_days_from_civil(y, mon, 1) + tm->tm_mday - 1) * TZ_DAY +
+               tm->tm_hour * 3600LL + tm->tm_min * 60LL + tm->tm_sec;
+}
+
+time_t
+tz_mktime(struct tm *tm)
+{
+        const Tz_Table *tz = tz_table();
+        long long local;
+        time_t t;
+        time_t found = -1;
+        int valid = 0;
+        int i;
+
+        if (tz == NULL)
+                return mktime(tm);
+
+        /* A day away from the ends, so every offset can be tried */
+        local = tz_local_seconds(tm);
+        if (local - TZ_DAY < tz->from || local + TZ_DAY >= tz->to)
+                return mktime(tm);
+
+        /* The time is LOCAL minus the offset of the span it falls in. It
+         * can only be in the span of LOCAL as UTC or next to it */
+        i = tz_find(tz, local);
+        for (int k = i > 0 ? i - 1 : 0; k <= i + 1 && k < tz->count; k++) {
+                t = local - tz->spans[k].gmtoff;
+                if (t < tz->spans[k].at || (k + 1 < tz->count && t >= tz->spans[k + 1].at))
+                        continue;
+                /* The C library moves the time to match tm_isdst */
+                if (tm->tm_isdst >= 0 && (tm->tm_isdst > 0) != (tz->spans[k].isdst > 0))
+                        return mktime(tm);
+                found = t;
+                ++valid;
+        }
+
+        /* Skipped or repeated */
+        if (valid != 1)
+                return mktime(tm);
+
+        tz_localtime(&found, tm);
+        return found;
+}
+
+time_t
+tz_timegm(const struct tm *tm)
+{
+        return tz_local_seconds(tm);
+}
+
+#endif // TZ_IMPLEMENTATION
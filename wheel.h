@@ -0,0 +1,167 @@
+#ifndef WHEEL_H_
+#define WHEEL_H_
+
+/* wheel.h -- hierarchical timer wheel
+ *
+ * Author: Hugo Coto Florez
+ * Repo: https://github.com/hugootoflorez/todo
+ * License: licenseless
+ *
+ * Timers expire at a tick, as seconds since the epoch. Level L of the
+ * wheel has WHEEL_SLOTS slots of WHEEL_SLOTS^L ticks, so adding and
+ * cancelling a timer is O(1) however far it is: only the slot where it
+ * falls is touched. When the ticks of a slot of level L > 0 start, its
+ * timers are moved to the lower levels, and those of level 0 expire.
+ * Timers further than the last level wait in its last slot and are moved
+ * again when they get closer.
+ *
+ * Timers are embedded in the structs of the caller, nothing is allocated.
+ * The wheel is not thread safe.
+ *
+ * Usage:
+ *   Wheel w;
+ *   wheel_init(&w, time(NULL));
+ *   wheel_add(&w, &r->timer, due);
+ *   wheel_advance(&w, time(NULL), fire, NULL);
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 5 /* 64^5 s, 34 years */
+
+typedef struct Wheel_Timer {
+        struct Wheel_Timer *next;
+        struct Wheel_Timer **pprev; /* NULL if it is not in a wheel */
+        int64_t expires;
+} Wheel_Timer;
+
+typedef struct {
+        int64_t now; /* first tick not expired yet */
+        Wheel_Timer *slots[WHEEL_LEVELS][WHEEL_SLOTS];
+} Wheel;
+
+void wheel_init(Wheel *w, int64_t now);
+/* Add T to expire at the tick EXPIRES. Timers in the past expire in the
+ * next tick. T must not be in a wheel */
+void wheel_add(Wheel *w, Wheel_Timer *t, int64_t expires);
+/* Remove T from its wheel, if it is in one */
+void wheel_cancel(Wheel_Timer *t);
+bool wheel_pending(const Wheel_Timer *t);
+/* Expire the timers of the ticks up to NOW, included, calling FIRE with
+ * each one and ARG, once it is out of the wheel. FIRE can add and cancel
+ * timers */
+void wheel_advance(Wheel *w, int64_t now, void (*fire)(Wheel_Timer *t, void *arg), void *arg);
+
+#endif // WHEEL_H_
+
+#ifdef WHEEL_IMPLEMENTATION
+
+#include <string.h>
+
+void
+wheel_init(Wheel *w, int64_t now)
+{
+        memset(w, 0, sizeof *w);
+        w->now = now;
+}
+
+static void
+wheel_link(Wheel_Timer **slot, Wheel_Timer *t)
+{
+        t->next = *slot;
+        if (*slot)
+                (*slot)->pprev = &t->next;
+        t->pprev = slot;
+        *slot = t;
+}
+
+/* Slot of T from the tick W->NOW. A timer at level L is moved down in
+ * the first tick of its slot, that is never after it expires */
+static Wheel_Timer **
+wheel_slot(Wheel *w, const Wheel_Timer *t)
+{
+        int64_t delta = t->expires - w->now;
+        int64_t at = t->expires;
+        int level;
+
+        if (delta < 0)
+                at = w->now;
+        for (level = 0; level < WHEEL_LEVELS - 1; level++)
+                if (delta < (int64_t) 1 << (WHEEL_BITS * (level + 1)))
+                        break;
+        /* Beyond the last level: its last slot from now */
+        if (level == WHEEL_LEVELS - 1 && delta >= (int64_t) 1 << (WHEEL_BITS * WHEEL_LEVELS))
+                at = w->now + ((int64_t) (WHEEL_SLOTS - 1) << (WHEEL_BITS * level));
+        return &w->slots[level][(at >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1)];
+}
+
+void
+wheel_add(Wheel *w, Wheel_Timer *t, int64_t expires)
+{
+        t->expires = expires;
+        wheel_link(wheel_slot(w, t), t);
+}
+
+void
+wheel_cancel(Wheel_Timer *t)
+{
+        if (t->pprev == NULL)
+                return;
+        *t->pprev = t->next;
+        if (t->next)
+                t->next->pprev = t->pprev;
+        t->next = NULL;
+        t->pprev = NULL;
+}
+
+bool
+wheel_pending(const Wheel_Timer *t)
+{
+        return t->pprev != NULL;
+}
+
+/* Move the timers of SLOT to LIST, so they can still be cancelled */
+static void
+wheel_take(Wheel_Timer **slot, Wheel_Timer **list)
+{
+        *list = *slot;
+        *slot = NULL;
+        if (*list)
+                (*list)->pprev = list;
+}
+
+void
+wheel_advance(Wheel *w, int64_t now, void (*fire)(Wheel_Timer *t, void *arg), void *arg)
+{
+        Wheel_Timer *list;
+        Wheel_Timer *t;
+        int64_t tick;
+
+        while (w->now <= now) {
+                tick = w->now;
+                /* Move down the slots that start at this tick. Level L
+                 * starts a slot when the lower ones roll over */
+                for (int level = 1; level < WHEEL_LEVELS; level++) {
+                        if ((tick >> (WHEEL_BITS * (level - 1))) & (WHEEL_SLOTS - 1))
+                                break;
+                        wheel_take(&w->slots[level][(tick >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1)], &list);
+                        while ((t = list)) {
+                                wheel_cancel(t);
+                                wheel_link(wheel_slot(w, t), t);
+                        }
+                }
+
+                /* Timers added by FIRE for this tick go to the next one */
+                wheel_take(&w->slots[0][tick & (WHEEL_SLOTS - 1)], &list);
+                w->now = tick + 1;
+                while ((t = list)) {
+                        wheel_cancel(t);
+                        fire(t, arg);
+                }
+        }
+}
+
+#endif // WHEEL_IMPLEMENTATION